@@ -0,0 +1,977 @@
+// Microbenchmarks for vec_math.h, the mesh loader, the profiler and the GL helpers
+//
+//   bench.exe [--reps N] [--warmup N] [--min-sample-us N] [--filter STR]
+//             [--json FILE] [--csv FILE] [--no-gl] [--quiet]
+//   bench.exe --compare BASE.json NEW.json [--threshold PERCENT]
+//
+// Compare mode exits with 1 when any benchmark regressed, so it can gate CI.
+// The fast math in vec_math.h is checked against libm, and the cached
+// view_projection_t against project / unproject, before anything is timed;
+// the run exits with 1 when an error bound is exceeded.
+// Results are nanoseconds per call (throughput, calls are independent).
+
+// Request implementations
+#define _GLAD_IMPLEMENTATION_
+#define _GLFW_IMPLEMENTATION_
+#define _GL_HELPERS_IMPLEMENTATION_
+#define _VEC_MATH_IMPLEMENTATION_
+#define _MESH_DATA_IMPLEMENTATION_
+#define _BENCH_IMPLEMENTATION_
+#define _PROFILER_IMPLEMENTATION_
+#define PROF_ENABLED 1 // Measures what a zone costs when profiling is on
+
+// Detect OS
+#define PLATFORM_WINDOWS 0
+#define PLATFORM_LINUX   0
+#define PLATFORM_MACOS   0
+
+#if defined(_WIN32) || defined(_WIN64)
+#undef PLATFORM_WINDOWS
+#define PLATFORM_WINDOWS 1
+#elif defined(__linux__)
+#undef PLATFORM_LINUX
+#define PLATFORM_LINUX 1
+#elif defined(__ENVIRONMENT_MAC_OS_X_VERSION_MIN_REQUIRED__)
+#undef PLATFORM_MACOS
+#define PLATFORM_MACOS 1
+#else
+#error "Platform not recognized!"
+#endif
+
+// Specify windowing backend based on the OS
+#if PLATFORM_LINUX
+#define PLATFORM_NAME "Linux"
+#define _GLFW_X11
+#define _POSIX_C_SOURCE 199309L
+#define GLFW_INCLUDE_NONE
+#elif PLATFORM_MACOS
+#define PLATFORM_NAME "OSX"
+#define _GLFW_COCOA
+#define GL_SILENCE_DEPRECATION
+#define GLFW_INCLUDE_NONE
+#elif PLATFORM_WINDOWS
+#define PLATFORM_NAME "Windows"
+#define _GLFW_WIN32
+#define GLFW_INCLUDE_NONE
+#else
+#error "Unknown platform!"
+#endif
+
+// Clib includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <float.h>
+
+// Include libraries
+#include "libs/glfw.h"
+#include "libs/glad.h"
+#include "libs/gl_helpers.h"
+#include "libs/vec_math.h"
+#include "libs/mesh_data.h"
+#include "libs/bench.h"
+#include "libs/profiler.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//       VEC_MATH KERNELS
+////////////////////////////////////////////////////////////////////////////////
+
+// Inputs are drawn from pools so consecutive calls see different data and
+// nothing can be hoisted out of the loop; every result is stored so nothing
+// can be dropped either.
+#define POOL_SIZE 256
+#define POOL_MASK (POOL_SIZE - 1)
+
+static float S[POOL_SIZE];
+static vec2_t V2[POOL_SIZE];
+static vec3_t V3[POOL_SIZE];
+static vec4_t V4[POOL_SIZE];
+static mat2_t M2[POOL_SIZE];
+static mat3_t M3[POOL_SIZE];
+static mat4_t M4[POOL_SIZE];
+static view_projection_t VP;
+
+typedef union bench_slot {
+    float f;
+    int i;
+    vec2_t v2;
+    vec3_t v3;
+    vec4_t v4;
+    mat2_t m2;
+    mat3_t m3;
+    mat4_t m4;
+    view_projection_t vp;
+} bench_slot_t;
+
+bench_slot_t bench_sink[POOL_SIZE];
+
+static float random_float(float lo, float hi) {
+    return lo + (hi - lo) * ((float)rand() / (float)RAND_MAX);
+}
+
+static void init_pools(void) {
+    srand(1234);
+    for (int32_t i = 0; i < POOL_SIZE; ++i) {
+        S[i] = random_float(0.1f, 4.0f);
+        V2[i] = vec2(random_float(-4.0f, 4.0f), random_float(0.5f, 4.0f));
+        V3[i] = vec3(random_float(-4.0f, 4.0f), random_float(0.5f, 4.0f),
+                     random_float(-4.0f, 4.0f));
+        V4[i] = vec4(random_float(-4.0f, 4.0f), random_float(0.5f, 4.0f),
+                     random_float(-4.0f, 4.0f), 1.0f);
+
+        // Rotation, scale and translation keep every matrix invertible
+        vec3_t axis = vec3_normalize(V3[i]);
+        mat4_t m = mat4_make_rotation(axis, S[i]);
+        for (int32_t c = 0; c < 3; ++c) {
+            m.col[c] = vec4_scalar_mul(m.col[c], 0.5f + S[(i + c) & POOL_MASK]);
+        }
+        m.col[3] = V4[(i + 7) & POOL_MASK];
+        M4[i] = m;
+        M3[i] = mat4_to_mat3(m);
+        M2[i] = mat4_to_mat2(m);
+    }
+    VP = view_projection_make(look_at(vec3(0, 0, 3), vec3(0, 0, 0), vec3(0, 1, 0)),
+                              perspective(deg2rad(60.0f), 4.0f / 3.0f, 0.1f, 100.0f),
+                              vec4(0, 0, 800, 600));
+}
+
+static vec2_t sincos_fast_v2(float angle) {
+    vec2_t o;
+    scalar_sincos_fast(angle, &o.x, &o.y);
+    return o;
+}
+
+// X(name, sink slot, expression over pool entries a and b)
+#define VEC_MATH_KERNELS(X)                                                   \
+    X(deg2rad, f, deg2rad(S[a]))                                              \
+    X(rad2deg, f, rad2deg(S[a]))                                              \
+    X(vec2_add, v2, vec2_add(V2[a], V2[b]))                                   \
+    X(vec3_add, v3, vec3_add(V3[a], V3[b]))                                   \
+    X(vec4_add, v4, vec4_add(V4[a], V4[b]))                                   \
+    X(vec2_scalar_add, v2, vec2_scalar_add(V2[a], S[b]))                      \
+    X(vec3_scalar_add, v3, vec3_scalar_add(V3[a], S[b]))                      \
+    X(vec4_scalar_add, v4, vec4_scalar_add(V4[a], S[b]))                      \
+    X(vec2_sub, v2, vec2_sub(V2[a], V2[b]))                                   \
+    X(vec3_sub, v3, vec3_sub(V3[a], V3[b]))                                   \
+    X(vec4_sub, v4, vec4_sub(V4[a], V4[b]))                                   \
+    X(vec2_scalar_sub, v2, vec2_scalar_sub(V2[a], S[b]))                      \
+    X(vec3_scalar_sub, v3, vec3_scalar_sub(V3[a], S[b]))                      \
+    X(vec4_scalar_sub, v4, vec4_scalar_sub(V4[a], S[b]))                      \
+    X(vec2_mul, v2, vec2_mul(V2[a], V2[b]))                                   \
+    X(vec3_mul, v3, vec3_mul(V3[a], V3[b]))                                   \
+    X(vec4_mul, v4, vec4_mul(V4[a], V4[b]))                                   \
+    X(vec2_scalar_mul, v2, vec2_scalar_mul(V2[a], S[b]))                      \
+    X(vec3_scalar_mul, v3, vec3_scalar_mul(V3[a], S[b]))                      \
+    X(vec4_scalar_mul, v4, vec4_scalar_mul(V4[a], S[b]))                      \
+    X(vec2_div, v2, vec2_div(V2[a], V2[b]))                                   \
+    X(vec3_div, v3, vec3_div(V3[a], V3[b]))                                   \
+    X(vec4_div, v4, vec4_div(V4[a], V4[b]))                                   \
+    X(vec2_scalar_div, v2, vec2_scalar_div(V2[a], S[b]))                      \
+    X(vec3_scalar_div, v3, vec3_scalar_div(V3[a], S[b]))                      \
+    X(vec4_scalar_div, v4, vec4_scalar_div(V4[a], S[b]))                      \
+    X(vec2_abs, v2, vec2_abs(V2[a]))                                          \
+    X(vec3_abs, v3, vec3_abs(V3[a]))                                          \
+    X(vec4_abs, v4, vec4_abs(V4[a]))                                          \
+    X(vec2_sqrt, v2, vec2_sqrt(vec2_abs(V2[a])))                              \
+    X(vec3_sqrt, v3, vec3_sqrt(vec3_abs(V3[a])))                              \
+    X(vec4_sqrt, v4, vec4_sqrt(vec4_abs(V4[a])))                              \
+    X(vec2_clamp, v2, vec2_clamp(V2[a], -1.0f, 1.0f))                         \
+    X(vec3_clamp, v3, vec3_clamp(V3[a], -1.0f, 1.0f))                         \
+    X(vec4_clamp, v4, vec4_clamp(V4[a], -1.0f, 1.0f))                         \
+    X(vec2_invert, v2, vec2_invert(V2[a]))                                    \
+    X(vec3_invert, v3, vec3_invert(V3[a]))                                    \
+    X(vec4_invert, v4, vec4_invert(V4[a]))                                    \
+    X(vec2_normalize, v2, vec2_normalize(V2[a]))                              \
+    X(vec3_normalize, v3, vec3_normalize(V3[a]))                              \
+    X(vec4_normalize, v4, vec4_normalize(V4[a]))                              \
+    X(vec2_inner_product, f, vec2_inner_product(V2[a], V2[b]))                \
+    X(vec3_inner_product, f, vec3_inner_product(V3[a], V3[b]))                \
+    X(vec4_inner_product, f, vec4_inner_product(V4[a], V4[b]))                \
+    X(vec2_outer_product, m2, vec2_outer_product(V2[a], V2[b]))               \
+    X(vec3_outer_product, m3, vec3_outer_product(V3[a], V3[b]))               \
+    X(vec4_outer_product, m4, vec4_outer_product(V4[a], V4[b]))               \
+    X(vec2_dot, f, vec2_dot(V2[a], V2[b]))                                    \
+    X(vec3_dot, f, vec3_dot(V3[a], V3[b]))                                    \
+    X(vec4_dot, f, vec4_dot(V4[a], V4[b]))                                    \
+    X(vec3_cross, v3, vec3_cross(V3[a], V3[b]))                               \
+    X(vec2_norm, f, vec2_norm(V2[a]))                                         \
+    X(vec3_norm, f, vec3_norm(V3[a]))                                         \
+    X(vec4_norm, f, vec4_norm(V4[a]))                                         \
+    X(vec2_norm_sq, f, vec2_norm_sq(V2[a]))                                   \
+    X(vec3_norm_sq, f, vec3_norm_sq(V3[a]))                                   \
+    X(vec4_norm_sq, f, vec4_norm_sq(V4[a]))                                   \
+    X(scalar_lerp, f, scalar_lerp(S[a], S[b], 0.25f))                         \
+    X(vec2_lerp, v2, vec2_lerp(V2[a], V2[b], 0.25f))                          \
+    X(vec3_lerp, v3, vec3_lerp(V3[a], V3[b], 0.25f))                          \
+    X(vec4_lerp, v4, vec4_lerp(V4[a], V4[b], 0.25f))                          \
+    X(vec2_equal, i, vec2_equal(V2[a], V2[b]))                                \
+    X(vec3_equal, i, vec3_equal(V3[a], V3[b]))                                \
+    X(vec4_equal, i, vec4_equal(V4[a], V4[b]))                                \
+    X(mat3_to_mat2, m2, mat3_to_mat2(M3[a]))                                  \
+    X(mat4_to_mat2, m2, mat4_to_mat2(M4[a]))                                  \
+    X(mat4_to_mat3, m3, mat4_to_mat3(M4[a]))                                  \
+    X(mat2_to_mat3, m3, mat2_to_mat3(M2[a]))                                  \
+    X(mat2_to_mat4, m4, mat2_to_mat4(M2[a]))                                  \
+    X(mat3_to_mat4, m4, mat3_to_mat4(M3[a]))                                  \
+    X(mat2_add, m2, mat2_add(M2[a], M2[b]))                                   \
+    X(mat3_add, m3, mat3_add(M3[a], M3[b]))                                   \
+    X(mat4_add, m4, mat4_add(M4[a], M4[b]))                                   \
+    X(mat2_scalar_add, m2, mat2_scalar_add(M2[a], S[b]))                      \
+    X(mat3_scalar_add, m3, mat3_scalar_add(M3[a], S[b]))                      \
+    X(mat4_scalar_add, m4, mat4_scalar_add(M4[a], S[b]))                      \
+    X(mat2_sub, m2, mat2_sub(M2[a], M2[b]))                                   \
+    X(mat3_sub, m3, mat3_sub(M3[a], M3[b]))                                   \
+    X(mat4_sub, m4, mat4_sub(M4[a], M4[b]))                                   \
+    X(mat2_scalar_sub, m2, mat2_scalar_sub(M2[a], S[b]))                      \
+    X(mat3_scalar_sub, m3, mat3_scalar_sub(M3[a], S[b]))                      \
+    X(mat4_scalar_sub, m4, mat4_scalar_sub(M4[a], S[b]))                      \
+    X(mat2_mul, m2, mat2_mul(M2[a], M2[b]))                                   \
+    X(mat3_mul, m3, mat3_mul(M3[a], M3[b]))                                   \
+    X(mat4_mul, m4, mat4_mul(M4[a], M4[b]))                                   \
+    X(mat2_scalar_mul, m2, mat2_scalar_mul(M2[a], S[b]))                      \
+    X(mat3_scalar_mul, m3, mat3_scalar_mul(M3[a], S[b]))                      \
+    X(mat4_scalar_mul, m4, mat4_scalar_mul(M4[a], S[b]))                      \
+    X(mat2_vec2_mul, v2, mat2_vec2_mul(M2[a], V2[b]))                         \
+    X(mat3_vec3_mul, v3, mat3_vec3_mul(M3[a], V3[b]))                         \
+    X(mat4_vec3_mul, v3, mat4_vec3_mul(M4[a], V3[b], 1))                      \
+    X(mat4_vec4_mul, v4, mat4_vec4_mul(M4[a], V4[b]))                         \
+    X(mat2_scalar_div, m2, mat2_scalar_div(M2[a], S[b]))                      \
+    X(mat3_scalar_div, m3, mat3_scalar_div(M3[a], S[b]))                      \
+    X(mat4_scalar_div, m4, mat4_scalar_div(M4[a], S[b]))                      \
+    X(mat2_trace, f, mat2_trace(M2[a]))                                       \
+    X(mat3_trace, f, mat3_trace(M3[a]))                                       \
+    X(mat4_trace, f, mat4_trace(M4[a]))                                       \
+    X(mat2_determinant, f, mat2_determinant(M2[a]))                           \
+    X(mat3_determinant, f, mat3_determinant(M3[a]))                           \
+    X(mat4_determinant, f, mat4_determinant(M4[a]))                           \
+    X(mat2_frobenius_norm, f, mat2_frobenius_norm(M2[a]))                     \
+    X(mat3_frobenius_norm, f, mat3_frobenius_norm(M3[a]))                     \
+    X(mat4_frobenius_norm, f, mat4_frobenius_norm(M4[a]))                     \
+    X(mat2_inverse, m2, mat2_inverse(M2[a]))                                  \
+    X(mat3_inverse, m3, mat3_inverse(M3[a]))                                  \
+    X(mat4_inverse, m4, mat4_inverse(M4[a]))                                  \
+    X(mat4_se3_inverse, m4, mat4_se3_inverse(M4[a]))                          \
+    X(mat2_transpose, m2, mat2_transpose(M2[a]))                              \
+    X(mat3_transpose, m3, mat3_transpose(M3[a]))                              \
+    X(mat4_transpose, m4, mat4_transpose(M4[a]))                              \
+    X(look_at, m4, look_at(V3[a], V3[b], vec3(0, 1, 0)))                      \
+    X(frustum, m4, frustum(-S[a], S[a], -S[b], S[b], 0.1f, 100.0f))           \
+    X(perspective, m4, perspective(S[a], S[b], 0.1f, 100.0f))                 \
+    X(ortho, m4, ortho(-S[a], S[a], -S[b], S[b], 0.1f, 100.0f))               \
+    X(project, v3, project(V4[a], M4[b], VP.pm, VP.viewport))                 \
+    X(unproject, v4, unproject(V3[a], M4[b], VP.pm, VP.viewport))             \
+    X(view_projection_make, vp,                                               \
+      view_projection_make(M4[a], VP.pm, VP.viewport))                        \
+    X(view_projection_project, v3, view_projection_project(&VP, V4[a]))       \
+    X(view_projection_unproject, v4, view_projection_unproject(&VP, V3[a]))   \
+    X(mat4_make_translation, m4, mat4_make_translation(V3[a]))                \
+    X(mat4_make_rotation, m4, mat4_make_rotation(V3[a], S[b]))                \
+    X(mat3_to_euler, v3, mat3_to_euler(M3[a]))                                \
+    X(mat3_from_euler, m3, mat3_from_euler(V3[a]))                            \
+    X(mat2_equal, i, mat2_equal(M2[a], M2[b]))                                \
+    X(mat3_equal, i, mat3_equal(M3[a], M3[b]))                                \
+    X(mat4_equal, i, mat4_equal(M4[a], M4[b]))                                \
+    X(scalar_sincos_fast, v2, sincos_fast_v2(S[a] * 100.0f))                  \
+    X(scalar_sin_fast, f, scalar_sin_fast(S[a] * 100.0f))                     \
+    X(scalar_cos_fast, f, scalar_cos_fast(S[a] * 100.0f))                     \
+    X(scalar_rsqrt_fast, f, scalar_rsqrt_fast(S[a]))                          \
+    X(vec2_normalize_fast, v2, vec2_normalize_fast(V2[a]))                    \
+    X(vec3_normalize_fast, v3, vec3_normalize_fast(V3[a]))                    \
+    X(vec4_normalize_fast, v4, vec4_normalize_fast(V4[a]))                    \
+    X(mat4_make_rotation_fast, m4, mat4_make_rotation_fast(V3[a], S[b]))      \
+    X(look_at_fast, m4, look_at_fast(V3[a], V3[b], vec3(0, 1, 0)))
+
+#define X(name, slot, expr)                                                   \
+    static void bench_##name(void *user, int64_t iterations) {                \
+        (void)user;                                                           \
+        for (int64_t i = 0; i < iterations; ++i) {                            \
+            const int32_t a = (int32_t)(i & POOL_MASK);                       \
+            const int32_t b = (int32_t)((i * 7 + 3) & POOL_MASK);             \
+            (void)b;                                                          \
+            bench_sink[a].slot = (expr);                                      \
+        }                                                                     \
+    }
+VEC_MATH_KERNELS(X)
+#undef X
+
+// The batched calls are measured per whole pool, POOL_SIZE points per call
+static void bench_view_projection_project_n(void *user, int64_t iterations) {
+    (void)user;
+    static vec3_t out[POOL_SIZE];
+    for (int64_t i = 0; i < iterations; ++i) {
+        view_projection_project_n(&VP, V4, out, POOL_SIZE);
+    }
+    bench_sink[0].v3 = out[POOL_MASK];
+}
+
+static void bench_view_projection_unproject_n(void *user, int64_t iterations) {
+    (void)user;
+    static vec4_t out[POOL_SIZE];
+    for (int64_t i = 0; i < iterations; ++i) {
+        view_projection_unproject_n(&VP, V3, out, POOL_SIZE);
+    }
+    bench_sink[0].v4 = out[POOL_MASK];
+}
+
+typedef struct Kernel {
+    const char* name;
+    bench_fn fn;
+} Kernel;
+
+static const Kernel vec_math_kernels[] = {
+#define X(name, slot, expr) {"vec_math/" #name, bench_##name},
+    VEC_MATH_KERNELS(X)
+#undef X
+    {"vec_math/view_projection_project_n/256", bench_view_projection_project_n},
+    {"vec_math/view_projection_unproject_n/256", bench_view_projection_unproject_n},
+};
+
+void run_vec_math(bench_suite_t* suite) {
+    init_pools();
+    for (size_t i = 0; i < sizeof(vec_math_kernels) / sizeof(vec_math_kernels[0]); ++i) {
+        bench_run(suite, vec_math_kernels[i].name, vec_math_kernels[i].fn, NULL, 0.0);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//       VEC_MATH ACCURACY
+////////////////////////////////////////////////////////////////////////////////
+
+// Bounds documented next to the fast math declarations in vec_math.h
+#define SINCOS_FAST_MAX_ANGLE 8192.0f
+#define SINCOS_FAST_MAX_ERROR 1e-7
+#ifdef VEC_MATH_HAS_SSE
+#define RSQRT_FAST_MAX_ERROR 3e-7
+#else
+#define RSQRT_FAST_MAX_ERROR 5e-6
+#endif
+// The "few ulp" on top: rounding of the squared length and of the scaling
+#define NORMALIZE_FAST_MAX_ERROR (RSQRT_FAST_MAX_ERROR + 4.0 * FLT_EPSILON)
+
+static float float_from_bits(uint32_t bits) {
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static uint32_t float_to_bits(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+// Prints the worst error seen, returns 1 when it is above the bound
+static int32_t check_error(const char* name, double error, double bound, bool verbose) {
+    bool ok = error <= bound;
+    if (verbose || !ok) {
+        printf("check %-36s max error %9.3g, bound %9.3g%s\n", name, error, bound,
+               ok ? "" : "  FAILED");
+    }
+    return ok ? 0 : 1;
+}
+
+static double sincos_fast_error(float angle) {
+    float s, c;
+    scalar_sincos_fast(angle, &s, &c);
+    return fmax(fabs(s - sin(angle)), fabs(c - cos(angle)));
+}
+
+// Absolute error over |angle| <= SINCOS_FAST_MAX_ANGLE: a stride through the
+// float bit patterns covers small angles as densely as large ones, a uniform
+// grid of 2^-9 radians covers the range reduction boundaries.
+static double sincos_fast_max_error(void) {
+    double error = 0.0;
+    uint32_t last = float_to_bits(SINCOS_FAST_MAX_ANGLE);
+    for (uint32_t bits = 0; bits <= last; bits += 257) {
+        float angle = float_from_bits(bits);
+        error = fmax(error, fmax(sincos_fast_error(angle), sincos_fast_error(-angle)));
+    }
+    int32_t steps = (int32_t)(SINCOS_FAST_MAX_ANGLE * 512.0f);
+    for (int32_t i = -steps; i <= steps; ++i) {
+        error = fmax(error, sincos_fast_error((float)i / 512.0f));
+    }
+    return error;
+}
+
+static double rsqrt_fast_error(float x) {
+    double exact = 1.0 / sqrt(x);
+    return fabs(scalar_rsqrt_fast(x) - exact) / exact;
+}
+
+// Relative error, exhaustive over [1, 4) where both implementations repeat
+// themselves every two binades, then a stride over all positive normal floats
+static double rsqrt_fast_max_error(void) {
+    double error = 0.0;
+    uint32_t end = float_to_bits(4.0f);
+    for (uint32_t bits = float_to_bits(1.0f); bits < end; ++bits) {
+        error = fmax(error, rsqrt_fast_error(float_from_bits(bits)));
+    }
+    end = float_to_bits(FLT_MAX);
+    for (uint32_t bits = float_to_bits(FLT_MIN); bits <= end - 4099; bits += 4099) {
+        error = fmax(error, rsqrt_fast_error(float_from_bits(bits)));
+    }
+    return error;
+}
+
+// Error of the unit vector against the normalized double precision input,
+// over random directions with lengths from 2^-20 to 2^20
+static double normalize_fast_max_error(int32_t size) {
+    double error = 0.0;
+    for (int32_t i = 0; i < 1 << 20; ++i) {
+        float scale = ldexpf(1.0f, i % 41 - 20);
+        float v[4], n[4];
+        double length = 0.0;
+        for (int32_t c = 0; c < size; ++c) {
+            v[c] = random_float(-1.0f, 1.0f) * scale;
+            length += (double)v[c] * v[c];
+        }
+        length = sqrt(length);
+        if (size == 2) {
+            memcpy(n, vec2_normalize_fast(vec2(v[0], v[1])).data, 2 * sizeof(float));
+        } else if (size == 3) {
+            memcpy(n, vec3_normalize_fast(vec3(v[0], v[1], v[2])).data, 3 * sizeof(float));
+        } else {
+            memcpy(n, vec4_normalize_fast(vec4(v[0], v[1], v[2], v[3])).data, 4 * sizeof(float));
+        }
+        for (int32_t c = 0; c < size; ++c) {
+            error = fmax(error, fabs(n[c] - v[c] / length));
+        }
+    }
+    return error;
+}
+
+// The cached context only reorders the arithmetic of project / unproject, the
+// results may differ by rounding: a thousandth of a pixel (or of the depth
+// range) for window points, and relative to 1 + |expected| for object points,
+// whose depth is very sensitive to the window depth with a 0.1 near plane.
+#define VIEW_PROJECTION_PROJECT_MAX_ERROR 1e-3
+#define VIEW_PROJECTION_UNPROJECT_MAX_ERROR 5e-5
+#define VIEW_PROJECTION_POINTS 4096
+
+static double point_error(const float* a, const float* b, int32_t size, bool relative) {
+    double error = 0.0;
+    for (int32_t c = 0; c < size; ++c) {
+        error = fmax(error, fabs(a[c] - b[c]) / (relative ? 1.0 + fabs(b[c]) : 1.0));
+    }
+    return error;
+}
+
+// Compares view_projection_project (unproject) and its _n variant with
+// project (unproject) on random points in front of the camera. The window
+// points are the projected ones, so unproject stays away from the far plane.
+static double view_projection_max_error(bool batched, bool inverse) {
+    static vec4_t obj[VIEW_PROJECTION_POINTS];
+    static vec3_t win[VIEW_PROJECTION_POINTS];
+    static vec3_t win_n[VIEW_PROJECTION_POINTS];
+    static vec4_t obj_n[VIEW_PROJECTION_POINTS];
+    mat4_t modelview = look_at(vec3(1, 2, 3), vec3(0, 0, 0), vec3(0, 1, 0));
+    mat4_t projection = perspective(deg2rad(60.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+    vec4_t viewport = vec4(0, 0, 800, 600);
+    view_projection_t vp = view_projection_make(modelview, projection, viewport);
+
+    for (int32_t i = 0; i < VIEW_PROJECTION_POINTS; ++i) {
+        obj[i] = vec4(random_float(-1.5f, 1.5f), random_float(-1.5f, 1.5f),
+                      random_float(-1.5f, 1.5f), 1.0f);
+        win[i] = project(obj[i], modelview, projection, viewport);
+    }
+    view_projection_project_n(&vp, obj, win_n, VIEW_PROJECTION_POINTS);
+    view_projection_unproject_n(&vp, win, obj_n, VIEW_PROJECTION_POINTS);
+
+    double error = 0.0;
+    for (int32_t i = 0; i < VIEW_PROJECTION_POINTS; ++i) {
+        if (inverse) {
+            vec4_t o = batched ? obj_n[i] : view_projection_unproject(&vp, win[i]);
+            vec4_t expected = unproject(win[i], modelview, projection, viewport);
+            error = fmax(error, point_error(o.data, expected.data, 4, true));
+        } else {
+            vec3_t w = batched ? win_n[i] : view_projection_project(&vp, obj[i]);
+            error = fmax(error, point_error(w.data, win[i].data, 3, false));
+        }
+    }
+    return error;
+}
+
+// Returns the number of violated bounds
+static int32_t check_vec_math(bool verbose) {
+    srand(4321);
+    int32_t failures = 0;
+    failures += check_error("scalar_sincos_fast", sincos_fast_max_error(),
+                            SINCOS_FAST_MAX_ERROR, verbose);
+    failures += check_error("scalar_rsqrt_fast", rsqrt_fast_max_error(),
+                            RSQRT_FAST_MAX_ERROR, verbose);
+    failures += check_error("vec2_normalize_fast", normalize_fast_max_error(2),
+                            NORMALIZE_FAST_MAX_ERROR, verbose);
+    failures += check_error("vec3_normalize_fast", normalize_fast_max_error(3),
+                            NORMALIZE_FAST_MAX_ERROR, verbose);
+    failures += check_error("vec4_normalize_fast", normalize_fast_max_error(4),
+                            NORMALIZE_FAST_MAX_ERROR, verbose);
+    failures += check_error("view_projection_project", view_projection_max_error(false, false),
+                            VIEW_PROJECTION_PROJECT_MAX_ERROR, verbose);
+    failures += check_error("view_projection_project_n", view_projection_max_error(true, false),
+                            VIEW_PROJECTION_PROJECT_MAX_ERROR, verbose);
+    failures += check_error("view_projection_unproject", view_projection_max_error(false, true),
+                            VIEW_PROJECTION_UNPROJECT_MAX_ERROR, verbose);
+    failures += check_error("view_projection_unproject_n", view_projection_max_error(true, true),
+                            VIEW_PROJECTION_UNPROJECT_MAX_ERROR, verbose);
+    return failures;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//       MESH LOADER
+////////////////////////////////////////////////////////////////////////////////
+
+#define MESH_FILE "bench_mesh.bin"
+
+// A sphere-like grid with roughly twice as many triangles as vertices, which
+// is the ratio of data/armadillo.bin
+static MeshData make_grid_mesh(int32_t side) {
+    MeshData mesh = {0};
+    mesh.vertex_count = side * side;
+    mesh.triangle_count = 2 * (side - 1) * (side - 1);
+    mesh.vertex_data = (float*)malloc((size_t)mesh.vertex_count * 6 * sizeof(float));
+    mesh.triangles = (uint32_t*)malloc((size_t)mesh.triangle_count * 3 * sizeof(uint32_t));
+
+    for (int32_t y = 0; y < side; ++y) {
+        for (int32_t x = 0; x < side; ++x) {
+            float theta = (float)PI * y / (side - 1);
+            float phi = 2.0f * (float)PI * x / (side - 1);
+            float* v = mesh.vertex_data + 6 * (y * side + x);
+            v[0] = v[3] = sinf(theta) * cosf(phi); // Unit sphere, so position == normal
+            v[1] = v[4] = cosf(theta);
+            v[2] = v[5] = sinf(theta) * sinf(phi);
+        }
+    }
+
+    uint32_t* t = mesh.triangles;
+    for (int32_t y = 0; y + 1 < side; ++y) {
+        for (int32_t x = 0; x + 1 < side; ++x) {
+            uint32_t i = y * side + x;
+            *t++ = i; *t++ = i + side; *t++ = i + 1;
+            *t++ = i + 1; *t++ = i + side; *t++ = i + side + 1;
+        }
+    }
+    return mesh;
+}
+
+static void bench_load_mesh(void* user, int64_t iterations) {
+    (void)user;
+    for (int64_t i = 0; i < iterations; ++i) {
+        MeshData mesh = {0};
+        if (load_mesh_data(MESH_FILE, &mesh)) {
+            exit(EXIT_FAILURE);
+        }
+        bench_sink[i & POOL_MASK].f = mesh.vertex_data[mesh.vertex_count - 1];
+        free(mesh.vertex_data);
+        free(mesh.triangles);
+    }
+}
+
+void run_mesh_loader(bench_suite_t* suite) {
+    // 1k, 16k, 256k and 1M vertices; the armadillo has ~25k
+    const int32_t sides[] = {32, 128, 512, 1024};
+    for (size_t i = 0; i < sizeof(sides) / sizeof(sides[0]); ++i) {
+        char name[BENCH_NAME_LENGTH];
+        snprintf(name, sizeof(name), "mesh/load_mesh_data/%d_vertices", sides[i] * sides[i]);
+        if (!bench_selected(suite, name)) {
+            continue;
+        }
+
+        MeshData mesh = make_grid_mesh(sides[i]);
+        if (save_mesh_data(MESH_FILE, &mesh)) {
+            exit(EXIT_FAILURE);
+        }
+        double bytes = 2 * sizeof(uint32_t) + (double)mesh.vertex_count * 6 * sizeof(float) +
+                       (double)mesh.triangle_count * 3 * sizeof(uint32_t);
+        free(mesh.vertex_data);
+        free(mesh.triangles);
+
+        // The file is read from the page cache, so this is the parsing and copy cost
+        bench_run(suite, name, bench_load_mesh, NULL, bytes);
+        remove(MESH_FILE);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//       PROFILER
+////////////////////////////////////////////////////////////////////////////////
+
+// One empty zone per operation: two timestamps and the event store. The
+// buffer is cleared before it fills up, a full one only counts drops.
+static void bench_prof_zone(void* user, int64_t iterations) {
+    (void)user;
+    for (int64_t i = 0; i < iterations; ++i) {
+        if (!(i & (PROF_MAX_EVENTS / 2 - 1))) {
+            prof_clear();
+        }
+        PROF_BEGIN("bench");
+        PROF_END();
+    }
+}
+
+void run_profiler(bench_suite_t* suite) {
+    PROF_INIT();
+    bench_run(suite, "profiler/zone", bench_prof_zone, NULL, 0.0);
+    prof_clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//       SHADERS
+////////////////////////////////////////////////////////////////////////////////
+
+// Representative of the solution's shaders: a minimal pass-through pair and a
+// lit pair with the same amount of math as the armadillo shading.
+const char* small_vrtx_src = GLH_SHADER_HEADER GLH_STRINGIFY(
+    layout(location = 0) in vec3 pos;
+    uniform mat4 mvp;
+    void main() { gl_Position = mvp * vec4(pos, 1.0); }
+);
+
+const char* small_frag_src = GLH_SHADER_HEADER GLH_STRINGIFY(
+    out vec4 frag_color;
+    void main() { frag_color = vec4(1.0, 0.5, 0.2, 1.0); }
+);
+
+const char* lit_vrtx_src = GLH_SHADER_HEADER GLH_STRINGIFY(
+    layout(location = 0) in vec3 pos;
+    layout(location = 1) in vec3 nor;
+    uniform mat4 model_view;
+    uniform mat4 mvp;
+    uniform mat3 normal_matrix;
+    out vec3 frag_pos;
+    out vec3 normal;
+    void main() {
+        frag_pos = vec3(model_view * vec4(pos, 1.0));
+        normal = normal_matrix * nor;
+        gl_Position = mvp * vec4(pos, 1.0);
+    }
+);
+
+const char* lit_frag_src = GLH_SHADER_HEADER GLH_STRINGIFY(
+    in vec3 frag_pos;
+    in vec3 normal;
+    uniform vec3 light_pos;
+    uniform vec3 color;
+    out vec4 frag_color;
+    void main() {
+        vec3 n = normalize(normal);
+        vec3 l = normalize(light_pos - frag_pos);
+        vec3 v = normalize(-frag_pos);
+        vec3 r = reflect(-l, n);
+        float diffuse = max(dot(n, l), 0.0);
+        float specular = pow(max(dot(v, r), 0.0), 32.0);
+        frag_color = vec4(color * (0.2 + diffuse) + vec3(0.5 * specular), 1.0);
+    }
+);
+
+// Drivers cache compiled shaders by source, a unique comment per sample
+// makes every compile a cold one
+static const char* salted_source(const char* src, int32_t salt) {
+    static char buffer[4096];
+    snprintf(buffer, sizeof(buffer), "%s\n// bench %d\n", src, salt);
+    return buffer;
+}
+
+static int32_t shader_salt = 0;
+
+// Program binaries of the warm start, deleted again once measured so the
+// working directory is left as it was. remove() only deletes files on Windows
+#define BENCH_SHADER_CACHE "bench_shader_cache"
+#if PLATFORM_WINDOWS
+#include <direct.h>
+#define bench_rmdir(path) _rmdir(path)
+#else
+#define bench_rmdir(path) remove(path)
+#endif
+
+void bench_shader_pair(bench_suite_t* suite, const char* label,
+                       const char* vrtx_src, const char* frag_src) {
+    char names[4][BENCH_NAME_LENGTH];
+    snprintf(names[0], sizeof(names[0]), "gl/compile_vertex/%s", label);
+    snprintf(names[1], sizeof(names[1]), "gl/compile_fragment/%s", label);
+    snprintf(names[2], sizeof(names[2]), "gl/link_program/%s", label);
+    snprintf(names[3], sizeof(names[3]), "gl/load_program_cached/%s", label);
+    bool cold = bench_selected(suite, names[0]) || bench_selected(suite, names[1]) ||
+                bench_selected(suite, names[2]);
+    bool warm = bench_selected(suite, names[3]);
+    if (!cold && !warm) {
+        return;
+    }
+
+    const int32_t count = suite->options.repetitions;
+    double* compile_vrtx = (double*)malloc(count * sizeof(double));
+    double* compile_frag = (double*)malloc(count * sizeof(double));
+    double* link = (double*)malloc(count * sizeof(double));
+
+    for (int32_t i = -suite->options.warmup; cold && i < count; ++i) {
+        ++shader_salt;
+        // Querying the compile / link status inside the helpers waits for the
+        // driver, so the times include any deferred work
+        double t0 = bench_now_ns();
+        GLuint vrtx = glh_compile_shader_src(GL_VERTEX_SHADER, salted_source(vrtx_src, shader_salt));
+        double t1 = bench_now_ns();
+        GLuint frag = glh_compile_shader_src(GL_FRAGMENT_SHADER, salted_source(frag_src, shader_salt));
+        double t2 = bench_now_ns();
+        GLuint program = glh_link_program(vrtx, 0, frag);
+        double t3 = bench_now_ns();
+        glDeleteProgram(program);
+        if (i >= 0) {
+            compile_vrtx[i] = t1 - t0;
+            compile_frag[i] = t2 - t1;
+            link[i] = t3 - t2;
+        }
+    }
+
+    if (cold) {
+        bench_add_samples(suite, names[0], compile_vrtx, count, 0.0);
+        bench_add_samples(suite, names[1], compile_frag, count, 0.0);
+        bench_add_samples(suite, names[2], link, count, 0.0);
+    }
+
+    // Warm start: the first build fills the program binary cache, the
+    // measured ones only load the binary
+    if (warm) {
+        glh_program_job_t fill = {vrtx_src, NULL, frag_src};
+        glh_submit_programs(BENCH_SHADER_CACHE, &fill, 1);
+        glh_finish_programs(&fill, 1);
+        glDeleteProgram(fill.program);
+        for (int32_t i = 0; i < count; ++i) {
+            double t0 = bench_now_ns();
+            GLuint program = glh_load_program(BENCH_SHADER_CACHE, vrtx_src, NULL, frag_src);
+            link[i] = bench_now_ns() - t0;
+            glDeleteProgram(program);
+        }
+        bench_add_samples(suite, names[3], link, count, 0.0);
+        if (fill.cache_path[0]) {
+            remove(fill.cache_path);
+        }
+    }
+    free(compile_vrtx);
+    free(compile_frag);
+    free(link);
+}
+
+// Per-draw uniforms for thousands of draws: one glProgramUniformMatrix4fv per
+// draw against glh_uniform_ring, which writes every block through a single
+// mapping and binds a range per draw. One point per draw keeps the GPU side
+// negligible, the time is the CPU cost of issuing the frame.
+#define BENCH_DRAWS 4096
+
+const char* block_vrtx_src = GLH_SHADER_HEADER GLH_STRINGIFY(
+    layout(std140) uniform DrawBlock { mat4 mvp; };
+    void main() { gl_Position = mvp * vec4(0.0, 0.0, 0.0, 1.0); }
+);
+
+const char* point_vrtx_src = GLH_SHADER_HEADER GLH_STRINGIFY(
+    uniform mat4 mvp;
+    void main() { gl_Position = mvp * vec4(0.0, 0.0, 0.0, 1.0); }
+);
+
+void bench_draw_uniforms(bench_suite_t* suite) {
+    const int32_t count = suite->options.repetitions;
+    double* samples = (double*)malloc(count * sizeof(double));
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    mat4_t mvp = mat4_identity();
+
+    GLuint program = glh_load_program(NULL, point_vrtx_src, NULL, small_frag_src);
+    GLint location = glGetUniformLocation(program, "mvp");
+    glUseProgram(program);
+    if (bench_selected(suite, "gl/draw_uniforms/program_uniform_4096")) {
+        for (int32_t i = -suite->options.warmup; i < count; ++i) {
+            double t0 = bench_now_ns();
+            for (int32_t d = 0; d < BENCH_DRAWS; ++d) {
+                mvp.data[12] = (float)d; // a new value every draw, like real per-draw data
+                glProgramUniformMatrix4fv(program, location, 1, GL_FALSE, mvp.data);
+                glDrawArrays(GL_POINTS, 0, 1);
+            }
+            double t1 = bench_now_ns();
+            glFinish();
+            if (i >= 0) {
+                samples[i] = t1 - t0;
+            }
+        }
+        bench_add_samples(suite, "gl/draw_uniforms/program_uniform_4096", samples, count, 0.0);
+    }
+    glDeleteProgram(program);
+
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    uint32_t block_size = (sizeof(mat4_t) + alignment - 1) / alignment * alignment;
+    glh_uniform_ring_t ring;
+    GLintptr* offsets = (GLintptr*)malloc(BENCH_DRAWS * sizeof(GLintptr));
+    program = glh_load_program(NULL, block_vrtx_src, NULL, small_frag_src);
+    glUniformBlockBinding(program, glGetUniformBlockIndex(program, "DrawBlock"), 0);
+    glUseProgram(program);
+    if (bench_selected(suite, "gl/draw_uniforms/uniform_ring_4096") &&
+        !glh_uniform_ring_init(&ring, BENCH_DRAWS * block_size, 3)) {
+        for (int32_t i = -suite->options.warmup; i < count; ++i) {
+            double t0 = bench_now_ns();
+            glh_uniform_ring_begin_frame(&ring);
+            for (int32_t d = 0; d < BENCH_DRAWS; ++d) {
+                mvp.data[12] = (float)d;
+                void* block = glh_uniform_ring_alloc(&ring, sizeof(mat4_t), &offsets[d]);
+                memcpy(block, mvp.data, sizeof(mat4_t));
+            }
+            for (int32_t d = 0; d < BENCH_DRAWS; ++d) {
+                glh_uniform_ring_bind(&ring, 0, offsets[d], sizeof(mat4_t));
+                glDrawArrays(GL_POINTS, 0, 1);
+            }
+            glh_uniform_ring_end_frame(&ring);
+            double t1 = bench_now_ns();
+            glFinish();
+            if (i >= 0) {
+                samples[i] = t1 - t0;
+            }
+        }
+        bench_add_samples(suite, "gl/draw_uniforms/uniform_ring_4096", samples, count, 0.0);
+        glh_uniform_ring_free(&ring);
+    }
+    glDeleteProgram(program);
+    glDeleteVertexArrays(1, &vao);
+    free(offsets);
+    free(samples);
+}
+
+// Every GL benchmark, so no context is created when the filter selects none
+static const char* gl_bench_names[] = {
+    "gl/compile_vertex/small",   "gl/compile_fragment/small",
+    "gl/link_program/small",     "gl/load_program_cached/small",
+    "gl/compile_vertex/lit",     "gl/compile_fragment/lit",
+    "gl/link_program/lit",       "gl/load_program_cached/lit",
+    "gl/draw_uniforms/program_uniform_4096",
+    "gl/draw_uniforms/uniform_ring_4096",
+};
+
+void run_shaders(bench_suite_t* suite) {
+    bool selected = false;
+    for (size_t i = 0; i < sizeof(gl_bench_names) / sizeof(gl_bench_names[0]); ++i) {
+        selected = selected || bench_selected(suite, gl_bench_names[i]);
+    }
+    if (!selected) {
+        return;
+    }
+    if (!glfwInit()) {
+        printf("Failed to initialize GLFW, skipping GL benchmarks\n");
+        return;
+    }
+
+    // Hidden window, only the context is needed
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "bench", NULL, NULL);
+    if (!window) {
+        glfwTerminate();
+        printf("Failed to create window, skipping GL benchmarks\n");
+        return;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        fprintf(stderr, "[ERROR] Failed to initialize OpenGL context!\n");
+        exit(EXIT_FAILURE);
+    }
+    glh_init((GLADloadproc)glfwGetProcAddress);
+    bench_set_context(suite, "gl_renderer", (const char*)glGetString(GL_RENDERER));
+    bench_set_context(suite, "gl_version", (const char*)glGetString(GL_VERSION));
+
+    bench_shader_pair(suite, "small", small_vrtx_src, small_frag_src);
+    bench_shader_pair(suite, "lit", lit_vrtx_src, lit_frag_src);
+    bench_draw_uniforms(suite);
+    bench_rmdir(BENCH_SHADER_CACHE); // Fails harmlessly when it was never created
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//       MAIN
+////////////////////////////////////////////////////////////////////////////////
+
+static void usage(const char* exe) {
+    printf("usage: %s [--reps N] [--warmup N] [--min-sample-us N] [--filter STR]\n"
+           "          [--json FILE] [--csv FILE] [--no-gl] [--quiet]\n"
+           "       %s --compare BASE.json NEW.json [--threshold PERCENT]\n", exe, exe);
+}
+
+int32_t main(int32_t argc, char** argv) {
+    bench_options_t options = bench_default_options();
+    const char* json_path = NULL;
+    const char* csv_path = NULL;
+    const char* compare[2] = {NULL, NULL};
+    double threshold = 5.0;
+    bool use_gl = true;
+
+    for (int32_t i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (!strcmp(arg, "--reps") && has_value) {
+            options.repetitions = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--warmup") && has_value) {
+            options.warmup = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--min-sample-us") && has_value) {
+            options.min_sample_ns = atof(argv[++i]) * 1000.0;
+        } else if (!strcmp(arg, "--filter") && has_value) {
+            options.filter = argv[++i];
+        } else if (!strcmp(arg, "--json") && has_value) {
+            json_path = argv[++i];
+        } else if (!strcmp(arg, "--csv") && has_value) {
+            csv_path = argv[++i];
+        } else if (!strcmp(arg, "--threshold") && has_value) {
+            threshold = atof(argv[++i]);
+        } else if (!strcmp(arg, "--compare") && i + 2 < argc) {
+            compare[0] = argv[++i];
+            compare[1] = argv[++i];
+        } else if (!strcmp(arg, "--no-gl")) {
+            use_gl = false;
+        } else if (!strcmp(arg, "--quiet")) {
+            options.verbose = false;
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Compare mode: no benchmarks are run
+    if (compare[0]) {
+        bench_suite_t base, current;
+        bench_init(&base, options);
+        bench_init(&current, options);
+        if (bench_read_json(&base, compare[0]) || bench_read_json(&current, compare[1])) {
+            return EXIT_FAILURE;
+        }
+        int32_t regressions = bench_compare(&base, &current, threshold / 100.0, stdout);
+        bench_free(&base);
+        bench_free(&current);
+        return regressions ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    bench_suite_t suite;
+    bench_init(&suite, options);
+    bench_set_context(&suite, "platform", PLATFORM_NAME);
+#ifdef __VERSION__
+    bench_set_context(&suite, "compiler", __VERSION__);
+#endif
+
+    int32_t failures = check_vec_math(options.verbose);
+    run_vec_math(&suite);
+    run_mesh_loader(&suite);
+    run_profiler(&suite);
+    if (use_gl) {
+        run_shaders(&suite);
+    }
+
+    if (json_path && bench_write_json(&suite, json_path)) {
+        return EXIT_FAILURE;
+    }
+    if (csv_path && bench_write_csv(&suite, csv_path)) {
+        return EXIT_FAILURE;
+    }
+    bench_free(&suite);
+    PROF_SHUTDOWN();
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,455 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+// Small benchmark harness. A benchmark is a function that performs
+// `iterations` operations; the harness grows the batch until one sample takes
+// at least min_sample_ns, discards `warmup` samples, then records
+// `repetitions` samples and summarizes them in nanoseconds per operation.
+//
+//   bench_suite_t suite;
+//   bench_init(&suite, bench_default_options());
+//   bench_run(&suite, "vec_math/mat4_mul", bench_mat4_mul, NULL, 0.0);
+//   bench_write_json(&suite, "results.json");
+//
+// Results written with bench_write_json can be read back and compared, which
+// is how regressions between two builds are found.
+
+#define BENCH_NAME_LENGTH 96
+#define BENCH_MAX_SAMPLES 4096
+#define BENCH_MAX_CONTEXT 16
+
+typedef void (*bench_fn)(void *user, int64_t iterations);
+
+typedef struct bench_options {
+  int32_t warmup;       // samples discarded before measuring
+  int32_t repetitions;  // samples measured, at most BENCH_MAX_SAMPLES
+  double min_sample_ns; // batch grows until one sample takes this long
+  const char *filter;   // substring of the names to run, NULL runs all
+  bool verbose;         // print every result to stdout as it finishes
+} bench_options_t;
+
+typedef struct bench_result {
+  char name[BENCH_NAME_LENGTH];
+  int64_t iterations; // operations per sample
+  int32_t samples;
+  double median; // all times in ns per operation
+  double p95;
+  double p99;
+  double mad; // median absolute deviation from the median
+  double mean;
+  double min;
+  double max;
+  double bytes;      // processed per operation, 0 when not meaningful
+  double throughput; // MB/s at the median, 0 when bytes is 0
+  double rate;       // operations per second at the median (e.g. frames/s)
+} bench_result_t;
+
+typedef struct bench_suite {
+  bench_options_t options;
+  bench_result_t *results;
+  int32_t count;
+  int32_t capacity;
+  char context[BENCH_MAX_CONTEXT][2][BENCH_NAME_LENGTH];
+  int32_t context_count;
+} bench_suite_t;
+
+bench_options_t bench_default_options(void);
+void bench_init(bench_suite_t *suite, bench_options_t options);
+void bench_free(bench_suite_t *suite);
+void bench_set_context(bench_suite_t *suite, const char *key,
+                       const char *value);
+
+double bench_now_ns(void);
+bool bench_selected(const bench_suite_t *suite, const char *name);
+
+// Calibrates, warms up and measures fn. Returns NULL when filtered out.
+const bench_result_t *bench_run(bench_suite_t *suite, const char *name,
+                                bench_fn fn, void *user, double bytes);
+// Adds samples timed by the caller, one operation each, for work that can not
+// be repeated in a tight loop (e.g. a link that consumes its shaders).
+const bench_result_t *bench_add_samples(bench_suite_t *suite, const char *name,
+                                        double *samples_ns, int32_t count,
+                                        double bytes);
+// Sorts samples in place and fills the statistics of out.
+void bench_summarize(double *samples_ns, int32_t count, bench_result_t *out);
+
+int8_t bench_write_json(const bench_suite_t *suite, const char *path);
+int8_t bench_write_csv(const bench_suite_t *suite, const char *path);
+int8_t bench_read_json(bench_suite_t *suite, const char *path);
+
+// Matches results by name and flags a regression when the new median is more
+// than threshold (0.05 = 5%) slower and the difference is larger than three
+// times the combined MAD, so noisy benchmarks do not fail spuriously.
+// Returns the number of regressions, the report goes to stream.
+int32_t bench_compare(const bench_suite_t *base, const bench_suite_t *current,
+                      double threshold, FILE *stream);
+#endif /* _BENCH_H_ */
+
+#ifdef _BENCH_IMPLEMENTATION_
+
+#if defined(_WIN32) || defined(_WIN64)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+bench_options_t bench_default_options(void) {
+  bench_options_t options = {0};
+  options.warmup = 5;
+  options.repetitions = 31;
+  options.min_sample_ns = 200000.0;
+  options.filter = NULL;
+  options.verbose = true;
+  return options;
+}
+
+void bench_init(bench_suite_t *suite, bench_options_t options) {
+  memset(suite, 0, sizeof(*suite));
+  if (options.repetitions < 1) {
+    options.repetitions = 1;
+  }
+  if (options.repetitions > BENCH_MAX_SAMPLES) {
+    options.repetitions = BENCH_MAX_SAMPLES;
+  }
+  if (options.warmup < 0) {
+    options.warmup = 0;
+  }
+  suite->options = options;
+}
+
+void bench_free(bench_suite_t *suite) {
+  free(suite->results);
+  suite->results = NULL;
+  suite->count = 0;
+  suite->capacity = 0;
+}
+
+void bench_set_context(bench_suite_t *suite, const char *key,
+                       const char *value) {
+  int32_t i = 0;
+  while (i < suite->context_count && strcmp(suite->context[i][0], key)) {
+    ++i;
+  }
+  if (i == BENCH_MAX_CONTEXT) {
+    return;
+  }
+  snprintf(suite->context[i][0], BENCH_NAME_LENGTH, "%s", key);
+  snprintf(suite->context[i][1], BENCH_NAME_LENGTH, "%s", value ? value : "");
+  if (i == suite->context_count) {
+    suite->context_count++;
+  }
+}
+
+double bench_now_ns(void) {
+#if defined(_WIN32) || defined(_WIN64)
+  static LARGE_INTEGER frequency;
+  LARGE_INTEGER counter;
+  if (!frequency.QuadPart) {
+    QueryPerformanceFrequency(&frequency);
+  }
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart * 1e9 / (double)frequency.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+bool bench_selected(const bench_suite_t *suite, const char *name) {
+  return !suite->options.filter || strstr(name, suite->options.filter);
+}
+
+static int bench__compare_double(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static double bench__sorted_median(const double *sorted, int32_t count) {
+  if (count & 1) {
+    return sorted[count / 2];
+  }
+  return 0.5 * (sorted[count / 2 - 1] + sorted[count / 2]);
+}
+
+void bench_summarize(double *samples_ns, int32_t count, bench_result_t *out) {
+  out->samples = count;
+  if (count <= 0) {
+    return;
+  }
+  qsort(samples_ns, count, sizeof(double), bench__compare_double);
+
+  double sum = 0.0;
+  for (int32_t i = 0; i < count; ++i) {
+    sum += samples_ns[i];
+  }
+  out->mean = sum / count;
+  out->min = samples_ns[0];
+  out->max = samples_ns[count - 1];
+  out->median = bench__sorted_median(samples_ns, count);
+
+  // Nearest rank, with few samples this is simply the maximum
+  int32_t rank = (int32_t)ceil(0.95 * count) - 1;
+  out->p95 = samples_ns[rank < 0 ? 0 : rank];
+  rank = (int32_t)ceil(0.99 * count) - 1;
+  out->p99 = samples_ns[rank < 0 ? 0 : rank];
+
+  double *deviation = (double *)malloc(count * sizeof(double));
+  for (int32_t i = 0; i < count; ++i) {
+    deviation[i] = fabs(samples_ns[i] - out->median);
+  }
+  qsort(deviation, count, sizeof(double), bench__compare_double);
+  out->mad = bench__sorted_median(deviation, count);
+  free(deviation);
+
+  out->throughput = 0.0;
+  if (out->bytes > 0.0 && out->median > 0.0) {
+    out->throughput = out->bytes / out->median * 1e9 / (1024.0 * 1024.0);
+  }
+  out->rate = out->median > 0.0 ? 1e9 / out->median : 0.0;
+}
+
+static bench_result_t *bench__append(bench_suite_t *suite, const char *name) {
+  if (suite->count == suite->capacity) {
+    int32_t capacity = suite->capacity ? suite->capacity * 2 : 64;
+    bench_result_t *results = (bench_result_t *)realloc(
+        suite->results, capacity * sizeof(bench_result_t));
+    if (!results) {
+      fprintf(stderr, "[BENCH] Out of memory\n");
+      exit(-1);
+    }
+    suite->results = results;
+    suite->capacity = capacity;
+  }
+  bench_result_t *result = &suite->results[suite->count++];
+  memset(result, 0, sizeof(*result));
+  snprintf(result->name, BENCH_NAME_LENGTH, "%s", name);
+  return result;
+}
+
+static void bench__report(const bench_suite_t *suite,
+                          const bench_result_t *result) {
+  if (!suite->options.verbose) {
+    return;
+  }
+  printf("%-48s median %12.2f ns  p99 %12.2f ns  mad %10.2f ns", result->name,
+         result->median, result->p99, result->mad);
+  if (result->throughput > 0.0) {
+    printf("  %10.1f MB/s", result->throughput);
+  }
+  printf("\n");
+}
+
+const bench_result_t *bench_run(bench_suite_t *suite, const char *name,
+                                bench_fn fn, void *user, double bytes) {
+  if (!bench_selected(suite, name)) {
+    return NULL;
+  }
+
+  // Grow the batch until a sample is long enough for the timer resolution
+  int64_t iterations = 1;
+  for (;;) {
+    double start = bench_now_ns();
+    fn(user, iterations);
+    double elapsed = bench_now_ns() - start;
+    if (elapsed >= suite->options.min_sample_ns || iterations >= (1LL << 40)) {
+      break;
+    }
+    int64_t scale = elapsed > 0.0
+                        ? (int64_t)(suite->options.min_sample_ns / elapsed) + 1
+                        : 10;
+    iterations *= scale < 2 ? 2 : (scale > 10 ? 10 : scale);
+  }
+
+  for (int32_t i = 0; i < suite->options.warmup; ++i) {
+    fn(user, iterations);
+  }
+
+  double samples[BENCH_MAX_SAMPLES];
+  for (int32_t i = 0; i < suite->options.repetitions; ++i) {
+    double start = bench_now_ns();
+    fn(user, iterations);
+    samples[i] = (bench_now_ns() - start) / (double)iterations;
+  }
+
+  bench_result_t *result = bench__append(suite, name);
+  result->iterations = iterations;
+  result->bytes = bytes;
+  bench_summarize(samples, suite->options.repetitions, result);
+  bench__report(suite, result);
+  return result;
+}
+
+const bench_result_t *bench_add_samples(bench_suite_t *suite, const char *name,
+                                        double *samples_ns, int32_t count,
+                                        double bytes) {
+  if (!bench_selected(suite, name) || count <= 0) {
+    return NULL;
+  }
+  bench_result_t *result = bench__append(suite, name);
+  result->iterations = 1;
+  result->bytes = bytes;
+  bench_summarize(samples_ns, count, result);
+  bench__report(suite, result);
+  return result;
+}
+
+int8_t bench_write_json(const bench_suite_t *suite, const char *path) {
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    perror("[BENCH] Failed to open json output");
+    return 1;
+  }
+
+  fprintf(file, "{\n  \"context\": {");
+  for (int32_t i = 0; i < suite->context_count; ++i) {
+    fprintf(file, "%s\n    \"%s\": \"", i ? "," : "", suite->context[i][0]);
+    for (const char *c = suite->context[i][1]; *c; ++c) {
+      if (*c == '"' || *c == '\\') {
+        fputc('\\', file);
+      }
+      fputc(*c, file);
+    }
+    fputc('"', file);
+  }
+  fprintf(file, "\n  },\n  \"benchmarks\": [\n");
+
+  // One result per line, bench_read_json relies on it
+  for (int32_t i = 0; i < suite->count; ++i) {
+    const bench_result_t *r = &suite->results[i];
+    fprintf(file,
+            "    {\"name\": \"%s\", \"iterations\": %lld, \"samples\": %d, "
+            "\"median_ns\": %.9g, \"p95_ns\": %.9g, \"p99_ns\": %.9g, "
+            "\"mad_ns\": %.9g, \"mean_ns\": %.9g, \"min_ns\": %.9g, "
+            "\"max_ns\": %.9g, \"bytes\": %.9g, \"mb_per_s\": %.9g, "
+            "\"ops_per_s\": %.9g}%s\n",
+            r->name, (long long)r->iterations, r->samples, r->median, r->p95,
+            r->p99, r->mad, r->mean, r->min, r->max, r->bytes, r->throughput,
+            r->rate, i + 1 < suite->count ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+  fclose(file);
+  return 0;
+}
+
+int8_t bench_write_csv(const bench_suite_t *suite, const char *path) {
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    perror("[BENCH] Failed to open csv output");
+    return 1;
+  }
+
+  fprintf(file, "name,iterations,samples,median_ns,p95_ns,p99_ns,mad_ns,"
+                "mean_ns,min_ns,max_ns,bytes,mb_per_s,ops_per_s\n");
+  for (int32_t i = 0; i < suite->count; ++i) {
+    const bench_result_t *r = &suite->results[i];
+    fprintf(file,
+            "%s,%lld,%d,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g\n",
+            r->name, (long long)r->iterations, r->samples, r->median, r->p95,
+            r->p99, r->mad, r->mean, r->min, r->max, r->bytes, r->throughput,
+            r->rate);
+  }
+  fclose(file);
+  return 0;
+}
+
+static double bench__json_number(const char *line, const char *key) {
+  const char *found = strstr(line, key);
+  return found ? atof(found + strlen(key)) : 0.0;
+}
+
+int8_t bench_read_json(bench_suite_t *suite, const char *path) {
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    perror("[BENCH] Failed to open json input");
+    return 1;
+  }
+
+  char line[1024];
+  while (fgets(line, sizeof(line), file)) {
+    const char *name = strstr(line, "{\"name\": \"");
+    if (!name) {
+      continue;
+    }
+    name += strlen("{\"name\": \"");
+    const char *end = strchr(name, '"');
+    if (!end || end - name >= BENCH_NAME_LENGTH) {
+      continue;
+    }
+
+    char key[BENCH_NAME_LENGTH];
+    memcpy(key, name, end - name);
+    key[end - name] = '\0';
+    bench_result_t *r = bench__append(suite, key);
+    r->iterations = (int64_t)bench__json_number(line, "\"iterations\": ");
+    r->samples = (int32_t)bench__json_number(line, "\"samples\": ");
+    r->median = bench__json_number(line, "\"median_ns\": ");
+    r->p95 = bench__json_number(line, "\"p95_ns\": ");
+    r->p99 = bench__json_number(line, "\"p99_ns\": ");
+    r->mad = bench__json_number(line, "\"mad_ns\": ");
+    r->mean = bench__json_number(line, "\"mean_ns\": ");
+    r->min = bench__json_number(line, "\"min_ns\": ");
+    r->max = bench__json_number(line, "\"max_ns\": ");
+    r->bytes = bench__json_number(line, "\"bytes\": ");
+    r->throughput = bench__json_number(line, "\"mb_per_s\": ");
+    r->rate = bench__json_number(line, "\"ops_per_s\": ");
+  }
+  fclose(file);
+  return 0;
+}
+
+int32_t bench_compare(const bench_suite_t *base, const bench_suite_t *current,
+                      double threshold, FILE *stream) {
+  int32_t regressions = 0;
+  int32_t improvements = 0;
+
+  fprintf(stream, "%-48s %12s %12s %9s\n", "benchmark", "base ns", "new ns",
+          "change");
+  for (int32_t i = 0; i < current->count; ++i) {
+    const bench_result_t *now = &current->results[i];
+    const bench_result_t *old = NULL;
+    for (int32_t j = 0; j < base->count && !old; ++j) {
+      if (!strcmp(base->results[j].name, now->name)) {
+        old = &base->results[j];
+      }
+    }
+    if (!old) {
+      fprintf(stream, "%-48s %12s %12.2f %9s\n", now->name, "-", now->median,
+              "new");
+      continue;
+    }
+
+    double delta = now->median - old->median;
+    double change = old->median > 0.0 ? delta / old->median : 0.0;
+    double noise = 3.0 * (old->mad + now->mad);
+    const char *verdict = "";
+    if (change > threshold && delta > noise) {
+      verdict = "  REGRESSION";
+      regressions++;
+    } else if (change < -threshold && -delta > noise) {
+      verdict = "  improved";
+      improvements++;
+    }
+    fprintf(stream, "%-48s %12.2f %12.2f %+8.1f%%%s\n", now->name, old->median,
+            now->median, 100.0 * change, verdict);
+  }
+
+  for (int32_t j = 0; j < base->count; ++j) {
+    bool found = false;
+    for (int32_t i = 0; i < current->count && !found; ++i) {
+      found = !strcmp(base->results[j].name, current->results[i].name);
+    }
+    if (!found) {
+      fprintf(stream, "%-48s %12.2f %12s %9s\n", base->results[j].name,
+              base->results[j].median, "-", "missing");
+    }
+  }
+
+  fprintf(stream, "%d regression(s), %d improvement(s) at %.1f%% threshold\n",
+          regressions, improvements, 100.0 * threshold);
+  return regressions;
+}
+
+#endif /* _BENCH_IMPLEMENTATION_ */
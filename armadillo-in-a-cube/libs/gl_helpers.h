@@ -3,22 +3,582 @@
 
 #define GLH_SHADER_HEADER "#version 410 core\n"
 #define GLH_STRINGIFY(x) #x
+
+// Debug layer, on unless NDEBUG is defined; -DGLH_DEBUG=0/1 overrides it.
+// With a debug output callback (KHR_debug or ARB_debug_output, see glh_init)
+// the driver reports every error at the call that raised it, so GLCHECK only
+// records its file and line for the report. Without one it falls back to
+// glGetError. In release GLCHECK is just the call: glGetError can stall the
+// pipeline and is never made.
+#ifndef GLH_DEBUG
+#ifdef NDEBUG
+#define GLH_DEBUG 0
+#else
+#define GLH_DEBUG 1
+#endif
+#endif
+
+#if GLH_DEBUG
+#define GLCHECK(x)                                                             \
+  do {                                                                         \
+    glh_debug_site.file = __FILE__;                                            \
+    glh_debug_site.line = __LINE__;                                            \
+    x;                                                                         \
+    glh_debug_site.file = NULL;                                                \
+    if (!glh_caps.debug_output) {                                              \
+      glh_check(__FILE__, __LINE__);                                           \
+    }                                                                          \
+  } while (0)
+#else
 #define GLCHECK(x)                                                             \
   do {                                                                         \
     x;                                                                         \
-    glh_check(__FILE__, __LINE__);                                             \
   } while (0)
+#endif
+
+// KHR_debug and ARB_debug_output share values
+#define GLH_DEBUG_OUTPUT 0x92E0
+#define GLH_DEBUG_OUTPUT_SYNCHRONOUS 0x8242
+#define GLH_DEBUG_TYPE_ERROR 0x824C
+#define GLH_DEBUG_SEVERITY_NOTIFICATION 0x826B
+#define GLH_DEBUG_SOURCE_APPLICATION 0x824A
+
+// KHR_parallel_shader_compile and ARB_parallel_shader_compile share values
+#define GLH_MAX_SHADER_COMPILER_THREADS 0x91B0
+#define GLH_COMPLETION_STATUS 0x91B1
+
+// Optional features of the current context, filled by glh_init
+typedef struct glh_caps {
+  bool parallel_shader_compile;
+  void(APIENTRYP max_shader_compiler_threads)(GLuint count);
+  // Errors reach glh_debug_callback, GLCHECK skips glGetError
+  bool debug_output;
+  // KHR_debug groups, NULL without it
+  void(APIENTRYP push_debug_group)(GLenum source, GLuint id, GLsizei length,
+                                   const GLchar *message);
+  void(APIENTRYP pop_debug_group)(void);
+} glh_caps_t;
+
+extern glh_caps_t glh_caps;
+
+// The GLCHECK in progress, so the debug callback can tell where errors are from
+typedef struct glh_debug_site {
+  const char *file; // NULL outside GLCHECK
+  uint32_t line;
+} glh_debug_site_t;
+
+extern glh_debug_site_t glh_debug_site;
+
+// Call once after gladLoadGLLoader, with the same loader. Detects optional
+// extensions; every helper still works when it is not called. With GLH_DEBUG
+// it also installs glh_debug_callback when the context has a debug output
+// extension (drivers may only report through it in debug contexts, e.g.
+// GLFW_OPENGL_DEBUG_CONTEXT). Release builds can ask for a no-error context
+// instead (GLFW_CONTEXT_NO_ERROR), where the driver skips error checking.
+void glh_init(GLADloadproc load);
+// Prints the message with the GLCHECK site, exits on errors like glh_check
+void APIENTRY glh_debug_callback(GLenum source, GLenum type, GLuint id,
+                                 GLenum severity, GLsizei length,
+                                 const GLchar *message, const void *user);
+bool glh_has_extension(const char *name);
+// Named region of GL calls for graphics debuggers (RenderDoc, Nsight,
+// apitrace), no-ops without KHR_debug. Groups nest and must be balanced.
+void glh_push_debug_group(const char *name);
+void glh_pop_debug_group(void);
 
 void glh_check(const char *filename, uint32_t lineno);
 int8_t glh_check_program_status(GLuint program_id, bool report_error);
 int8_t glh_check_shader_status(GLuint shader_id, bool report_error);
 GLuint glh_compile_shader_src(GLuint shader_type, const char *shader_src); 
 GLuint glh_link_program(GLuint vertex_shader, GLuint geometry_shader, GLuint fragment_shader);
+
+// Compiles and links the given sources (geometry_src may be NULL), going
+// through an on-disk cache of program binaries in cache_dir. The cache key is
+// a hash of the sources, GL_RENDERER and GL_VERSION, so a driver update or a
+// shader edit simply misses. A binary the driver rejects is recompiled and
+// overwritten. With cache_dir NULL, or without binary formats, this is just
+// compile + link. Exits on compile or link errors.
+GLuint glh_load_program(const char *cache_dir, const char *vertex_src,
+                        const char *geometry_src, const char *fragment_src);
+
+// Separable single-stage program (GL 4.1 separate shader objects), to be
+// combined with other stages in a pipeline, see glh_pipeline. With cache_dir
+// NULL this is glCreateShaderProgramv, otherwise it goes through the binary
+// cache like glh_load_program. Exits on compile or link errors. Vertex
+// shaders must redeclare gl_PerVertex, and stage interfaces should match by
+// layout(location).
+GLuint glh_load_stage_program(const char *cache_dir, GLenum stage,
+                              const char *src);
+
+// Batched, non-blocking variant of glh_load_program. Submit every program
+// first, do other loading work, then poll or finish. Compile and link status
+// are only queried once the driver reports completion (parallel shader
+// compile), so the driver compiles on its own threads in the meantime.
+// Without the extension, polling simply blocks like the single calls. A job
+// without a vertex or a fragment source is linked as a separable program.
+enum {
+  GLH_PROGRAM_COMPILING,
+  GLH_PROGRAM_LINKING,
+  GLH_PROGRAM_DONE,
+  GLH_PROGRAM_FAILED,
+};
+
+typedef struct glh_program_job {
+  const char *vertex_src; // inputs, geometry_src may be NULL
+  const char *geometry_src;
+  const char *fragment_src;
+  GLuint program; // output, valid once state is GLH_PROGRAM_DONE
+  int8_t state;
+  GLuint shaders[3];
+  char cache_path[256]; // empty when not cached
+} glh_program_job_t;
+
+void glh_submit_programs(const char *cache_dir, glh_program_job_t *jobs,
+                         int32_t count);
+// Advances jobs whose driver work completed, returns how many are pending
+int32_t glh_poll_programs(glh_program_job_t *jobs, int32_t count);
+// Blocks until every job is done, returns the number of failed jobs
+int32_t glh_finish_programs(glh_program_job_t *jobs, int32_t count);
+
+// Program reflection. Active uniforms and uniform blocks are enumerated once
+// after linking; lookups by name happen at init time and return a handle
+// (index into uniforms, -1 when the program does not use the name, in which
+// case setting it is a no-op like location -1). Setters keep a shadow copy
+// of the last value and only call glProgramUniform* when it changed, so
+// per-frame state that did not change costs no driver call. Arrays are
+// shadowed through element 0 only.
+#define GLH_MAX_UNIFORMS 32
+#define GLH_MAX_UNIFORM_BLOCKS 8
+#define GLH_MAX_NAME_LENGTH 64
+
+typedef struct glh_uniform {
+  char name[GLH_MAX_NAME_LENGTH]; // without a trailing "[0]"
+  GLint location;
+  GLenum type;
+  GLint size;     // array length, 1 for plain uniforms
+  bool uploaded;  // value holds what the program has
+  float value[16];
+} glh_uniform_t;
+
+typedef struct glh_uniform_block {
+  char name[GLH_MAX_NAME_LENGTH];
+  GLuint index;
+  GLint data_size; // bytes, as laid out by the driver
+} glh_uniform_block_t;
+
+typedef struct glh_program_info {
+  GLuint program;
+  int32_t uniform_count;
+  glh_uniform_t uniforms[GLH_MAX_UNIFORMS];
+  int32_t block_count;
+  glh_uniform_block_t blocks[GLH_MAX_UNIFORM_BLOCKS];
+  uint32_t uploads; // driver calls made by the setters
+  uint32_t skipped; // setter calls that found the value unchanged
+} glh_program_info_t;
+
+void glh_reflect_program(GLuint program, glh_program_info_t *info);
+int32_t glh_uniform(const glh_program_info_t *info, const char *name);
+int32_t glh_uniform_block(const glh_program_info_t *info, const char *name);
+// GLSL 4.10 has no layout(binding = N), blocks are bound from here instead.
+// Returns 1 when the program has no such block, or when expected_size is
+// non-zero and differs from the driver's layout (a C/GLSL std140 mismatch).
+int8_t glh_bind_uniform_block(const glh_program_info_t *info,
+                              const char *name, GLuint binding,
+                              int32_t expected_size);
+
+void glh_set_uniform_1i(glh_program_info_t *info, int32_t handle, int32_t v);
+void glh_set_uniform_1f(glh_program_info_t *info, int32_t handle, float v);
+void glh_set_uniform_3fv(glh_program_info_t *info, int32_t handle,
+                         const float *v);
+void glh_set_uniform_4fv(glh_program_info_t *info, int32_t handle,
+                         const float *v);
+void glh_set_uniform_mat3(glh_program_info_t *info, int32_t handle,
+                          const float *m);
+void glh_set_uniform_mat4(glh_program_info_t *info, int32_t handle,
+                          const float *m);
+// Forget the shadow copies, e.g. after uploading behind the setters' back
+void glh_invalidate_uniforms(glh_program_info_t *info);
+
+// Streaming ring of uniform blocks for per-draw data. The buffer is split in
+// frame_count regions, one per frame in flight. Every draw allocates its block
+// from the current region and binds it with glBindBufferRange. Writes go
+// through an unsynchronized mapping, so the driver never waits on the GPU.
+// Reuse is safe because each region is fenced at the end of its frame and the
+// fence is waited on before the region is written again. GL 4.1 cannot draw
+// from a mapped buffer, so binding unmaps it. Allocate every block of a batch
+// first and then bind and draw: each batch costs one map and one unmap, no
+// matter how many draws it has.
+#define GLH_MAX_FRAMES_IN_FLIGHT 4
+
+typedef struct glh_uniform_ring {
+  GLuint buffer;
+  GLint alignment;     // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+  uint32_t frame_size; // bytes per region
+  int32_t frame_count;
+  int32_t frame; // current region
+  uint32_t head; // next free byte in the current region
+  uint32_t mapped_offset; // start of the mapping within the region
+  uint8_t *mapped;        // NULL while unmapped
+  GLsync fences[GLH_MAX_FRAMES_IN_FLIGHT];
+  uint32_t stalls;   // frames that had to wait for the GPU
+  uint32_t overflows; // allocations that did not fit the region
+} glh_uniform_ring_t;
+
+// frame_size is rounded up to the offset alignment, frame_count is clamped to
+// [1, GLH_MAX_FRAMES_IN_FLIGHT]. Returns 1 when the buffer cannot be created.
+int8_t glh_uniform_ring_init(glh_uniform_ring_t *ring, uint32_t frame_size,
+                             int32_t frame_count);
+void glh_uniform_ring_free(glh_uniform_ring_t *ring);
+// Moves to the next region, waiting for the GPU only if it still reads it
+void glh_uniform_ring_begin_frame(glh_uniform_ring_t *ring);
+// Fences the region, call after the last draw of the frame
+void glh_uniform_ring_end_frame(glh_uniform_ring_t *ring);
+// Returns size writable bytes and their offset in ring->buffer, or NULL when
+// the region is full (size the ring for the worst frame)
+void *glh_uniform_ring_alloc(glh_uniform_ring_t *ring, uint32_t size,
+                             GLintptr *offset);
+// Unmaps if needed and binds [offset, offset + size) to the binding point
+void glh_uniform_ring_bind(glh_uniform_ring_t *ring, GLuint binding,
+                           GLintptr offset, GLsizeiptr size);
+
+// Render state objects. A glh_render_state_t holds everything a pass needs
+// bound or enabled. Build it at init from glh_default_render_state().
+// glh_state_apply compares it to what the tracker last set and only calls GL
+// for the fields that differ. The cost of a pass then depends on how much
+// actually changes, not on how many passes or draws there are. A state may
+// be modified between applies, e.g. to retarget a pass at another
+// framebuffer: the tracker diffs against what it last set, never against an
+// earlier version of the state. Texture units whose target is 0 are "don't
+// care" and keep whatever is bound. GL calls made outside the tracker are
+// invisible to it, so call glh_state_reset after them.
+#define GLH_MAX_TEXTURE_UNITS 4
+
+typedef struct glh_render_state {
+  GLuint framebuffer; // draw and read
+  GLint viewport[4];
+  bool scissor;        // clears and draws only touch scissor_box
+  GLint scissor_box[4]; // x, y, width, height, ignored while scissor is off
+  GLuint program;
+  GLuint pipeline; // used while program is 0
+  GLuint vao;
+  GLenum texture_targets[GLH_MAX_TEXTURE_UNITS]; // 0 when the unit is unused
+  GLuint textures[GLH_MAX_TEXTURE_UNITS];
+  bool depth_test;
+  bool depth_write;
+  GLenum depth_func;
+  bool blend;
+  GLenum blend_src, blend_dst;
+  bool cull;
+  GLenum cull_face;
+  float clear_color[4];
+} glh_render_state_t;
+
+typedef struct glh_state_tracker {
+  glh_render_state_t current; // what GL has, valid once applied
+  bool valid;
+  int32_t active_unit;
+  uint32_t changes; // GL state calls made since glh_state_begin_frame
+  uint32_t elided;  // calls skipped because the state was already set
+} glh_state_tracker_t;
+
+// GL's initial state, with no program, VAO or textures
+glh_render_state_t glh_default_render_state(void);
+// Clears the counters, the tracked state is kept across frames
+void glh_state_begin_frame(glh_state_tracker_t *tracker);
+// Forget what GL has, the next apply sets every field
+void glh_state_reset(glh_state_tracker_t *tracker);
+void glh_state_apply(glh_state_tracker_t *tracker,
+                     const glh_render_state_t *state);
+// Per-draw program on top of the applied state, e.g. a shader variant
+void glh_state_use_program(glh_state_tracker_t *tracker, GLuint program);
+// Per-draw pipeline, unbinds the program since it would take precedence
+void glh_state_use_pipeline(glh_state_tracker_t *tracker, GLuint pipeline);
+
+// Program pipelines. Each stage is its own separable program, compiled and
+// linked once; a pipeline only records which program runs which stage, so
+// mixing stages costs no link and memory grows with the number of stages,
+// not of combinations. Pipelines are created on first use and cached by
+// their stage programs.
+#define GLH_MAX_PIPELINES 32
+
+typedef struct glh_pipeline {
+  GLuint stages[3]; // vertex, geometry (may be 0), fragment programs
+  GLuint pipeline;
+} glh_pipeline_t;
+
+typedef struct glh_pipelines {
+  int32_t count;
+  glh_pipeline_t pipelines[GLH_MAX_PIPELINES];
+} glh_pipelines_t;
+
+// Returns the pipeline running these stage programs, 0 when the cache is full
+GLuint glh_pipeline(glh_pipelines_t *cache, GLuint vertex_program,
+                    GLuint geometry_program, GLuint fragment_program);
+void glh_pipelines_free(glh_pipelines_t *cache);
+
+// Shader permutations. One set of sources is written with #ifdef blocks on
+// feature flags. A variant is a bitmask of features: bit i inserts
+// "#define features[i]" right after GLH_SHADER_HEADER in every stage, so the
+// preprocessor strips the code a variant does not need and no branches are
+// left at runtime. Variants are built the first time they are requested and
+// kept. They go through the program binary cache, so each one is only
+// compiled once per driver. Give only the stage that varies (e.g. just the
+// fragment source) to get separable variants for glh_pipeline.
+// glh_permutations_request starts a build without waiting,
+// glh_permutations_get waits for it and is cheap once it is built.
+// The setup callback runs once per variant after linking and reflection,
+// e.g. to bind uniform blocks.
+#define GLH_MAX_FEATURES 8
+#define GLH_MAX_VARIANTS 16
+
+typedef struct glh_shader_variant {
+  uint32_t features;
+  bool ready; // linked, reflected and set up
+  glh_program_job_t job; // job.program is the variant's program
+  char *sources[3]; // with the #defines, freed once built
+  glh_program_info_t info;
+} glh_shader_variant_t;
+
+typedef struct glh_permutations {
+  const char *cache_dir;
+  const char *sources[3]; // vertex, geometry (may be NULL), fragment
+  const char *features[GLH_MAX_FEATURES];
+  int32_t feature_count;
+  void (*setup)(glh_shader_variant_t *variant, void *user);
+  void *user;
+  int32_t variant_count;
+  glh_shader_variant_t variants[GLH_MAX_VARIANTS];
+} glh_permutations_t;
+
+// Sources must start with GLH_SHADER_HEADER, setup may be NULL
+void glh_permutations_init(glh_permutations_t *perms, const char *cache_dir,
+                           const char *vertex_src, const char *geometry_src,
+                           const char *fragment_src,
+                           const char *const *features, int32_t feature_count,
+                           void (*setup)(glh_shader_variant_t *, void *),
+                           void *user);
+// Starts building the variant if it is new, never blocks
+glh_shader_variant_t *glh_permutations_request(glh_permutations_t *perms,
+                                               uint32_t features);
+// Returns the built variant, building it first if needed, NULL on errors
+glh_shader_variant_t *glh_permutations_get(glh_permutations_t *perms,
+                                           uint32_t features);
+// Deletes every variant's program
+void glh_permutations_free(glh_permutations_t *perms);
+
+// GPU pass timers. Each named pass is bracketed by two GL_TIMESTAMP queries
+// (glQueryCounter, which unlike GL_TIME_ELAPSED can nest and overlap). Every
+// frame uses its own set of queries out of GLH_GPU_TIMER_FRAMES, and results
+// are only read once GL_QUERY_RESULT_AVAILABLE says so, at least one frame
+// later: reading a timer never waits for the GPU. A set still unavailable
+// when its turn comes around again is dropped and counted. Each pass keeps
+// its last GLH_GPU_TIMER_HISTORY durations for the rolling statistics, with
+// the frame (glh_gpu_timer_begin_frame call, from 0) each one was issued in.
+// Without timer bits (GL_QUERY_COUNTER_BITS 0) every call is a no-op.
+#define GLH_MAX_GPU_PASSES 8
+#define GLH_GPU_TIMER_FRAMES 4
+#define GLH_GPU_TIMER_HISTORY 128
+
+typedef struct glh_gpu_pass {
+  char name[GLH_MAX_NAME_LENGTH];
+  GLuint queries[GLH_GPU_TIMER_FRAMES][2];      // begin and end timestamps
+  bool pending[GLH_GPU_TIMER_FRAMES];           // issued, result not read yet
+  double history[GLH_GPU_TIMER_HISTORY];        // milliseconds, circular
+  int64_t history_frame[GLH_GPU_TIMER_HISTORY]; // frame of each duration
+  uint32_t samples;                             // total results read
+} glh_gpu_pass_t;
+
+typedef struct glh_gpu_timer {
+  bool enabled;
+  int32_t frame;                        // query set of the current frame
+  int64_t frames;                       // glh_gpu_timer_begin_frame calls
+  int64_t issued[GLH_GPU_TIMER_FRAMES]; // frame each query set is used in
+  int32_t pass_count;
+  glh_gpu_pass_t passes[GLH_MAX_GPU_PASSES];
+  uint32_t dropped; // query sets reused before their result was available
+} glh_gpu_timer_t;
+
+// Rolling statistics over the history, in milliseconds
+typedef struct glh_gpu_stats {
+  double last;
+  double min;
+  double avg;
+  double p99;
+  uint32_t count; // samples the statistics cover
+} glh_gpu_stats_t;
+
+void glh_gpu_timer_init(glh_gpu_timer_t *timer);
+void glh_gpu_timer_free(glh_gpu_timer_t *timer);
+// Returns the handle of the named pass, creating it on first use; -1 when
+// there are GLH_MAX_GPU_PASSES already. Look passes up once, at init time.
+int32_t glh_gpu_pass(glh_gpu_timer_t *timer, const char *name);
+// Reads every result that became available and moves to the next query set.
+// Call once per frame, before the first pass.
+void glh_gpu_timer_begin_frame(glh_gpu_timer_t *timer);
+void glh_gpu_begin(glh_gpu_timer_t *timer, int32_t pass);
+void glh_gpu_end(glh_gpu_timer_t *timer, int32_t pass);
+// Returns 1 when the pass has no samples yet
+int8_t glh_gpu_stats(const glh_gpu_timer_t *timer, int32_t pass,
+                     glh_gpu_stats_t *stats);
+
+// Visibility queries. A GL_ANY_SAMPLES_PASSED query brackets the draws of an
+// object, every frame with its own query out of GLH_VISIBILITY_FRAMES, and
+// like the GPU timers results are only read once available: asking never
+// waits for the GPU. The answer is that of the newest frame with a result,
+// so it lags a frame or more behind. A zeroed glh_visibility_t is disabled,
+// every call is a no-op and it never reports the object hidden.
+#define GLH_VISIBILITY_FRAMES 4
+
+typedef struct glh_visibility {
+  bool enabled;
+  int32_t frame; // query of the current frame
+  GLuint queries[GLH_VISIBILITY_FRAMES];
+  bool pending[GLH_VISIBILITY_FRAMES]; // issued, result not read yet
+  int64_t issued[GLH_VISIBILITY_FRAMES]; // frame count when it was issued
+  int64_t frames;       // glh_visibility_begin_frame calls so far
+  int64_t result_frame; // frame count of the newest result, -1 before one
+  bool visible;         // any sample passed in that frame
+  uint32_t dropped;     // queries reused before their result was available
+} glh_visibility_t;
+
+void glh_visibility_init(glh_visibility_t *visibility);
+void glh_visibility_free(glh_visibility_t *visibility);
+// Reads every result that became available and moves to the next query.
+// Call once per frame, before glh_visibility_begin.
+void glh_visibility_begin_frame(glh_visibility_t *visibility);
+void glh_visibility_begin(glh_visibility_t *visibility);
+void glh_visibility_end(glh_visibility_t *visibility);
+// True when the newest result says no sample passed
+bool glh_visibility_hidden(const glh_visibility_t *visibility);
 #endif /* _GL_HELPERS_H_ */
 
 
 #ifdef _GL_HELPERS_IMPLEMENTATION_
 
+#if defined(_WIN32) || defined(_WIN64)
+#include <direct.h>
+#define glh__mkdir(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define glh__mkdir(path) mkdir(path, 0755)
+#endif
+
+#ifndef GL_NUM_EXTENSIONS
+#define GL_NUM_EXTENSIONS 0x821D
+#endif
+
+glh_caps_t glh_caps;
+glh_debug_site_t glh_debug_site;
+
+bool glh_has_extension(const char *name) {
+  int32_t count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (int32_t i = 0; i < count; ++i) {
+    const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+    if (extension && !strcmp(extension, name)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void glh_init(GLADloadproc load) {
+  memset(&glh_caps, 0, sizeof(glh_caps));
+
+  const char *max_threads = NULL;
+  if (glh_has_extension("GL_KHR_parallel_shader_compile")) {
+    max_threads = "glMaxShaderCompilerThreadsKHR";
+  } else if (glh_has_extension("GL_ARB_parallel_shader_compile")) {
+    max_threads = "glMaxShaderCompilerThreadsARB";
+  }
+  if (max_threads) {
+    glh_caps.max_shader_compiler_threads =
+        (void(APIENTRYP)(GLuint))load(max_threads);
+    glh_caps.parallel_shader_compile = true;
+  }
+  if (glh_caps.max_shader_compiler_threads) {
+    // 0xFFFFFFFF lets the implementation pick the thread count
+    glh_caps.max_shader_compiler_threads(0xFFFFFFFFu);
+  }
+
+#if GLH_DEBUG
+  // KHR_debug names its entry points without a suffix on desktop GL
+  const char *callback_name = NULL, *control_name = NULL;
+  bool khr = glh_has_extension("GL_KHR_debug");
+  if (khr) {
+    callback_name = "glDebugMessageCallback";
+    control_name = "glDebugMessageControl";
+  } else if (glh_has_extension("GL_ARB_debug_output")) {
+    callback_name = "glDebugMessageCallbackARB";
+    control_name = "glDebugMessageControlARB";
+  }
+  if (callback_name) {
+    void(APIENTRYP callback)(GLDEBUGPROC, const void *) =
+        (void(APIENTRYP)(GLDEBUGPROC, const void *))load(callback_name);
+    void(APIENTRYP control)(GLenum, GLenum, GLenum, GLsizei, const GLuint *,
+                            GLboolean) =
+        (void(APIENTRYP)(GLenum, GLenum, GLenum, GLsizei, const GLuint *,
+                         GLboolean))load(control_name);
+    if (callback && control) {
+      if (khr) {
+        glEnable(GLH_DEBUG_OUTPUT); // ARB_debug_output is always on
+      }
+      // Report inside the call that failed, so the site is still current
+      glEnable(GLH_DEBUG_OUTPUT_SYNCHRONOUS);
+      control(GL_DONT_CARE, GL_DONT_CARE, GLH_DEBUG_SEVERITY_NOTIFICATION, 0,
+              NULL, GL_FALSE);
+      callback(glh_debug_callback, NULL);
+      glh_caps.debug_output = true;
+    }
+  }
+#endif
+
+  // Debug groups cost next to nothing outside a debugger, so release builds
+  // keep them as well
+  if (glh_has_extension("GL_KHR_debug")) {
+    glh_caps.push_debug_group =
+        (void(APIENTRYP)(GLenum, GLuint, GLsizei, const GLchar *))load(
+            "glPushDebugGroup");
+    glh_caps.pop_debug_group = (void(APIENTRYP)(void))load("glPopDebugGroup");
+    if (!glh_caps.push_debug_group || !glh_caps.pop_debug_group) {
+      glh_caps.push_debug_group = NULL;
+      glh_caps.pop_debug_group = NULL;
+    }
+  }
+}
+
+void glh_push_debug_group(const char *name) {
+  if (glh_caps.push_debug_group) {
+    glh_caps.push_debug_group(GLH_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+  }
+}
+
+void glh_pop_debug_group(void) {
+  if (glh_caps.pop_debug_group) {
+    glh_caps.pop_debug_group();
+  }
+}
+
+void APIENTRY glh_debug_callback(GLenum source, GLenum type, GLuint id,
+                                 GLenum severity, GLsizei length,
+                                 const GLchar *message, const void *user) {
+  (void)source;
+  (void)severity;
+  (void)length;
+  (void)user;
+  bool error = type == GLH_DEBUG_TYPE_ERROR;
+  if (glh_debug_site.file) {
+    fprintf(stderr, "[GL] %s %u at %s: %u: %s\n", error ? "Error" : "Message",
+            id, glh_debug_site.file, glh_debug_site.line, message);
+  } else {
+    fprintf(stderr, "[GL] %s %u: %s\n", error ? "Error" : "Message", id,
+            message);
+  }
+  if (error) {
+    exit(-1);
+  }
+}
+
 void glh_check(const char *filename, uint32_t lineno) {
   uint32_t error = glGetError();
 
@@ -69,10 +629,8 @@ GLuint glh_compile_shader_src(GLuint shader_type, const char *shader_src) {
   return shader;
 }
 
-GLuint glh_link_program(GLuint vertex_shader, GLuint geometry_shader,
-                        GLuint fragment_shader) {
-  GLuint program = glCreateProgram();
-
+static void glh__link_shaders(GLuint program, GLuint vertex_shader,
+                              GLuint geometry_shader, GLuint fragment_shader) {
   if (vertex_shader) {
     glAttachShader(program, vertex_shader);
   }
@@ -97,9 +655,1087 @@ GLuint glh_link_program(GLuint vertex_shader, GLuint geometry_shader,
     glDetachShader(program, fragment_shader);
     glDeleteShader(fragment_shader);
   }
+}
 
+GLuint glh_link_program(GLuint vertex_shader, GLuint geometry_shader,
+                        GLuint fragment_shader) {
+  GLuint program = glCreateProgram();
+  glh__link_shaders(program, vertex_shader, geometry_shader, fragment_shader);
   glh_check_program_status(program, true);
   return program;
 }
 
+#define GLH_PROGRAM_CACHE_MAGIC 0x42484c47u /* "GLHB" */
+
+typedef struct glh_program_binary_header {
+  uint32_t magic;
+  uint32_t format;
+  uint32_t length;
+} glh_program_binary_header_t;
+
+static uint64_t glh__fnv1a(uint64_t hash, const void *data, size_t size) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+static uint64_t glh__fnv1a_str(uint64_t hash, const char *str) {
+  // The terminator is hashed too, so ("ab", "c") and ("a", "bc") differ
+  return str ? glh__fnv1a(hash, str, strlen(str) + 1) : glh__fnv1a(hash, "", 1);
+}
+
+static bool glh__job_separable(const glh_program_job_t *job) {
+  return !job->vertex_src || !job->fragment_src;
+}
+
+static GLuint glh__load_program_binary(const char *path, bool separable) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    return 0;
+  }
+
+  glh_program_binary_header_t header;
+  void *binary = NULL;
+  if (fread(&header, sizeof(header), 1, file) == 1 &&
+      header.magic == GLH_PROGRAM_CACHE_MAGIC && header.length > 0) {
+    binary = malloc(header.length);
+    if (binary && fread(binary, 1, header.length, file) != header.length) {
+      free(binary);
+      binary = NULL;
+    }
+  }
+  fclose(file);
+  if (!binary) {
+    return 0;
+  }
+
+  GLuint program = glCreateProgram();
+  if (separable) {
+    glProgramParameteri(program, GL_PROGRAM_SEPARABLE, GL_TRUE);
+  }
+  glProgramBinary(program, header.format, binary, header.length);
+  free(binary);
+
+  // Drivers reject binaries from other builds through the link status
+  int32_t linked = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &linked);
+  if (linked == GL_FALSE) {
+    fprintf(stderr, "[GL] Program binary %s rejected, recompiling\n", path);
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+static void glh__save_program_binary(GLuint program, const char *path) {
+  int32_t length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+
+  glh_program_binary_header_t header = {GLH_PROGRAM_CACHE_MAGIC, 0, 0};
+  void *binary = malloc(length);
+  GLenum format = 0;
+  glGetProgramBinary(program, length, &length, &format, binary);
+  header.format = format;
+  header.length = (uint32_t)length;
+
+  // Written next to the final name and renamed, so a crash never leaves a
+  // truncated binary behind
+  char tmp_path[512];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+  FILE *file = fopen(tmp_path, "wb");
+  if (!file) {
+    free(binary);
+    return;
+  }
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 fwrite(binary, 1, length, file) == (size_t)length;
+  fclose(file);
+  free(binary);
+
+  // rename replaces the old binary atomically on POSIX, Windows refuses to
+  // rename over an existing file
+#if defined(_WIN32) || defined(_WIN64)
+  remove(path);
+#endif
+  if (!written || rename(tmp_path, path)) {
+    remove(tmp_path);
+  }
+}
+
+void glh_submit_programs(const char *cache_dir, glh_program_job_t *jobs,
+                         int32_t count) {
+  int32_t format_count = 0;
+  if (cache_dir) {
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+  }
+
+  for (int32_t i = 0; i < count; ++i) {
+    glh_program_job_t *job = &jobs[i];
+    job->program = 0;
+    job->state = GLH_PROGRAM_COMPILING;
+    job->cache_path[0] = '\0';
+    memset(job->shaders, 0, sizeof(job->shaders));
+
+    if (format_count > 0) {
+      uint64_t key = 0xcbf29ce484222325ull;
+      key = glh__fnv1a_str(key, (const char *)glGetString(GL_RENDERER));
+      key = glh__fnv1a_str(key, (const char *)glGetString(GL_VERSION));
+      key = glh__fnv1a_str(key, job->vertex_src);
+      key = glh__fnv1a_str(key, job->geometry_src);
+      key = glh__fnv1a_str(key, job->fragment_src);
+      snprintf(job->cache_path, sizeof(job->cache_path), "%s/%016llx.bin",
+               cache_dir, (unsigned long long)key);
+
+      job->program =
+          glh__load_program_binary(job->cache_path, glh__job_separable(job));
+      if (job->program) {
+        job->state = GLH_PROGRAM_DONE;
+        continue;
+      }
+      glh__mkdir(cache_dir);
+    }
+
+    // Only submit here, the status is queried in glh_poll_programs
+    const GLenum types[3] = {GL_VERTEX_SHADER, GL_GEOMETRY_SHADER,
+                             GL_FRAGMENT_SHADER};
+    const char *sources[3] = {job->vertex_src, job->geometry_src,
+                              job->fragment_src};
+    for (int32_t s = 0; s < 3; ++s) {
+      if (sources[s]) {
+        job->shaders[s] = glCreateShader(types[s]);
+        glShaderSource(job->shaders[s], 1, &sources[s], NULL);
+        glCompileShader(job->shaders[s]);
+      }
+    }
+  }
+}
+
+static bool glh__completed(GLuint object, bool is_program) {
+  if (!glh_caps.parallel_shader_compile) {
+    return true;
+  }
+  int32_t completed = GL_TRUE;
+  if (is_program) {
+    glGetProgramiv(object, GLH_COMPLETION_STATUS, &completed);
+  } else {
+    glGetShaderiv(object, GLH_COMPLETION_STATUS, &completed);
+  }
+  return completed != GL_FALSE;
+}
+
+static void glh__delete_job_shaders(glh_program_job_t *job) {
+  for (int32_t s = 0; s < 3; ++s) {
+    if (job->shaders[s]) {
+      glDeleteShader(job->shaders[s]);
+      job->shaders[s] = 0;
+    }
+  }
+}
+
+int32_t glh_poll_programs(glh_program_job_t *jobs, int32_t count) {
+  int32_t pending = 0;
+  for (int32_t i = 0; i < count; ++i) {
+    glh_program_job_t *job = &jobs[i];
+
+    if (job->state == GLH_PROGRAM_COMPILING) {
+      bool completed = true;
+      for (int32_t s = 0; s < 3 && completed; ++s) {
+        completed = !job->shaders[s] || glh__completed(job->shaders[s], false);
+      }
+      if (!completed) {
+        pending++;
+        continue;
+      }
+
+      int8_t error = 0;
+      for (int32_t s = 0; s < 3; ++s) {
+        if (job->shaders[s]) {
+          error |= glh_check_shader_status(job->shaders[s], true);
+        }
+      }
+      if (error) {
+        glh__delete_job_shaders(job);
+        job->state = GLH_PROGRAM_FAILED;
+        continue;
+      }
+
+      job->program = glCreateProgram();
+      if (job->cache_path[0]) {
+        glProgramParameteri(job->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                            GL_TRUE);
+      }
+      if (glh__job_separable(job)) {
+        glProgramParameteri(job->program, GL_PROGRAM_SEPARABLE, GL_TRUE);
+      }
+      glh__link_shaders(job->program, job->shaders[0], job->shaders[1],
+                        job->shaders[2]);
+      memset(job->shaders, 0, sizeof(job->shaders)); // deleted by the link
+      job->state = GLH_PROGRAM_LINKING;
+    }
+
+    if (job->state == GLH_PROGRAM_LINKING) {
+      if (!glh__completed(job->program, true)) {
+        pending++;
+        continue;
+      }
+      if (glh_check_program_status(job->program, true)) {
+        glDeleteProgram(job->program);
+        job->program = 0;
+        job->state = GLH_PROGRAM_FAILED;
+        continue;
+      }
+      if (job->cache_path[0]) {
+        glh__save_program_binary(job->program, job->cache_path);
+      }
+      job->state = GLH_PROGRAM_DONE;
+    }
+  }
+  return pending;
+}
+
+int32_t glh_finish_programs(glh_program_job_t *jobs, int32_t count) {
+  // Nothing else to do, so let the status queries block instead of spinning
+  bool parallel = glh_caps.parallel_shader_compile;
+  glh_caps.parallel_shader_compile = false;
+  glh_poll_programs(jobs, count);
+  glh_caps.parallel_shader_compile = parallel;
+
+  int32_t failed = 0;
+  for (int32_t i = 0; i < count; ++i) {
+    failed += jobs[i].state == GLH_PROGRAM_FAILED;
+  }
+  return failed;
+}
+
+GLuint glh_load_program(const char *cache_dir, const char *vertex_src,
+                        const char *geometry_src, const char *fragment_src) {
+  glh_program_job_t job;
+  memset(&job, 0, sizeof(job));
+  job.vertex_src = vertex_src;
+  job.geometry_src = geometry_src;
+  job.fragment_src = fragment_src;
+  glh_submit_programs(cache_dir, &job, 1);
+  if (glh_finish_programs(&job, 1)) {
+    exit(-1);
+  }
+  return job.program;
+}
+
+GLuint glh_load_stage_program(const char *cache_dir, GLenum stage,
+                              const char *src) {
+  if (cache_dir) {
+    return glh_load_program(cache_dir,
+                            stage == GL_VERTEX_SHADER ? src : NULL,
+                            stage == GL_GEOMETRY_SHADER ? src : NULL,
+                            stage == GL_FRAGMENT_SHADER ? src : NULL);
+  }
+  // Compile, separable flag and link in one call, errors end up in the
+  // program's info log
+  GLuint program = glCreateShaderProgramv(stage, 1, &src);
+  if (glh_check_program_status(program, true)) {
+    exit(-1);
+  }
+  return program;
+}
+
+void glh_reflect_program(GLuint program, glh_program_info_t *info) {
+  memset(info, 0, sizeof(*info));
+  info->program = program;
+
+  int32_t count = 0;
+  glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+  for (int32_t i = 0; i < count; ++i) {
+    // Members of uniform blocks have no location, they are set through
+    // buffers and reported with their block below
+    GLuint index = (GLuint)i;
+    GLint block = -1;
+    glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_BLOCK_INDEX, &block);
+    if (block != -1) {
+      continue;
+    }
+    if (info->uniform_count == GLH_MAX_UNIFORMS) {
+      fprintf(stderr, "[GL] Program %u has more than %d uniforms\n", program,
+              GLH_MAX_UNIFORMS);
+      break;
+    }
+
+    glh_uniform_t *uniform = &info->uniforms[info->uniform_count++];
+    GLsizei length = 0;
+    glGetActiveUniform(program, index, GLH_MAX_NAME_LENGTH, &length,
+                       &uniform->size, &uniform->type, uniform->name);
+    char *bracket = strchr(uniform->name, '[');
+    if (bracket) {
+      *bracket = '\0';
+    }
+    uniform->location = glGetUniformLocation(program, uniform->name);
+  }
+
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+  for (int32_t i = 0; i < count && i < GLH_MAX_UNIFORM_BLOCKS; ++i) {
+    glh_uniform_block_t *block = &info->blocks[info->block_count++];
+    block->index = (GLuint)i;
+    glGetActiveUniformBlockName(program, block->index, GLH_MAX_NAME_LENGTH,
+                                NULL, block->name);
+    glGetActiveUniformBlockiv(program, block->index,
+                              GL_UNIFORM_BLOCK_DATA_SIZE, &block->data_size);
+  }
+}
+
+int32_t glh_uniform(const glh_program_info_t *info, const char *name) {
+  for (int32_t i = 0; i < info->uniform_count; ++i) {
+    if (!strcmp(info->uniforms[i].name, name)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int32_t glh_uniform_block(const glh_program_info_t *info, const char *name) {
+  for (int32_t i = 0; i < info->block_count; ++i) {
+    if (!strcmp(info->blocks[i].name, name)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int8_t glh_bind_uniform_block(const glh_program_info_t *info,
+                              const char *name, GLuint binding,
+                              int32_t expected_size) {
+  int32_t handle = glh_uniform_block(info, name);
+  if (handle < 0) {
+    return 1;
+  }
+  const glh_uniform_block_t *block = &info->blocks[handle];
+  if (expected_size && block->data_size != expected_size) {
+    fprintf(stderr, "[GL] Uniform block %s is %d bytes, expected %d\n", name,
+            block->data_size, expected_size);
+    return 1;
+  }
+  glUniformBlockBinding(info->program, block->index, binding);
+  return 0;
+}
+
+// True when the value differs from the shadow copy, which is then updated
+static bool glh__uniform_changed(glh_program_info_t *info, int32_t handle,
+                                 GLenum type, const void *value,
+                                 size_t bytes) {
+  if (handle < 0 || handle >= info->uniform_count) {
+    return false;
+  }
+  glh_uniform_t *uniform = &info->uniforms[handle];
+  if (uniform->type != type &&
+      !(type == GL_INT && (uniform->type == GL_SAMPLER_2D ||
+                           uniform->type == GL_SAMPLER_2D_ARRAY ||
+                           uniform->type == GL_SAMPLER_CUBE ||
+                           uniform->type == GL_BOOL))) {
+    fprintf(stderr, "[GL] Uniform %s set with the wrong type\n",
+            uniform->name);
+    return false;
+  }
+  if (uniform->uploaded && !memcmp(uniform->value, value, bytes)) {
+    info->skipped++;
+    return false;
+  }
+  memcpy(uniform->value, value, bytes);
+  uniform->uploaded = true;
+  info->uploads++;
+  return true;
+}
+
+void glh_set_uniform_1i(glh_program_info_t *info, int32_t handle, int32_t v) {
+  if (glh__uniform_changed(info, handle, GL_INT, &v, sizeof(v))) {
+    glProgramUniform1i(info->program, info->uniforms[handle].location, v);
+  }
+}
+
+void glh_set_uniform_1f(glh_program_info_t *info, int32_t handle, float v) {
+  if (glh__uniform_changed(info, handle, GL_FLOAT, &v, sizeof(v))) {
+    glProgramUniform1f(info->program, info->uniforms[handle].location, v);
+  }
+}
+
+void glh_set_uniform_3fv(glh_program_info_t *info, int32_t handle,
+                         const float *v) {
+  if (glh__uniform_changed(info, handle, GL_FLOAT_VEC3, v, 3 * sizeof(float))) {
+    glProgramUniform3fv(info->program, info->uniforms[handle].location, 1, v);
+  }
+}
+
+void glh_set_uniform_4fv(glh_program_info_t *info, int32_t handle,
+                         const float *v) {
+  if (glh__uniform_changed(info, handle, GL_FLOAT_VEC4, v, 4 * sizeof(float))) {
+    glProgramUniform4fv(info->program, info->uniforms[handle].location, 1, v);
+  }
+}
+
+void glh_set_uniform_mat3(glh_program_info_t *info, int32_t handle,
+                          const float *m) {
+  if (glh__uniform_changed(info, handle, GL_FLOAT_MAT3, m, 9 * sizeof(float))) {
+    glProgramUniformMatrix3fv(info->program, info->uniforms[handle].location,
+                              1, GL_FALSE, m);
+  }
+}
+
+void glh_set_uniform_mat4(glh_program_info_t *info, int32_t handle,
+                          const float *m) {
+  if (glh__uniform_changed(info, handle, GL_FLOAT_MAT4, m,
+                           16 * sizeof(float))) {
+    glProgramUniformMatrix4fv(info->program, info->uniforms[handle].location,
+                              1, GL_FALSE, m);
+  }
+}
+
+void glh_invalidate_uniforms(glh_program_info_t *info) {
+  for (int32_t i = 0; i < info->uniform_count; ++i) {
+    info->uniforms[i].uploaded = false;
+  }
+}
+
+int8_t glh_uniform_ring_init(glh_uniform_ring_t *ring, uint32_t frame_size,
+                             int32_t frame_count) {
+  memset(ring, 0, sizeof(*ring));
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &ring->alignment);
+  if (ring->alignment < 1) {
+    ring->alignment = 256;
+  }
+  uint32_t align = (uint32_t)ring->alignment;
+  ring->frame_size = (frame_size + align - 1) / align * align;
+  ring->frame_count = frame_count < 1 ? 1
+                      : frame_count > GLH_MAX_FRAMES_IN_FLIGHT
+                          ? GLH_MAX_FRAMES_IN_FLIGHT
+                          : frame_count;
+  ring->frame = ring->frame_count - 1; // the first begin_frame wraps to 0
+
+  glGenBuffers(1, &ring->buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer);
+  glBufferData(GL_UNIFORM_BUFFER,
+               (GLsizeiptr)ring->frame_size * ring->frame_count, NULL,
+               GL_STREAM_DRAW);
+  GLint allocated = 0;
+  glGetBufferParameteriv(GL_UNIFORM_BUFFER, GL_BUFFER_SIZE, &allocated);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  if ((uint32_t)allocated != ring->frame_size * ring->frame_count) {
+    fprintf(stderr, "[GL] Could not allocate a %u byte uniform ring\n",
+            ring->frame_size * ring->frame_count);
+    glDeleteBuffers(1, &ring->buffer);
+    ring->buffer = 0;
+    return 1;
+  }
+  return 0;
+}
+
+void glh_uniform_ring_free(glh_uniform_ring_t *ring) {
+  for (int32_t i = 0; i < GLH_MAX_FRAMES_IN_FLIGHT; ++i) {
+    if (ring->fences[i]) {
+      glDeleteSync(ring->fences[i]);
+    }
+  }
+  glDeleteBuffers(1, &ring->buffer);
+  memset(ring, 0, sizeof(*ring));
+}
+
+// Flushes what was written since the mapping and unmaps
+static void glh__uniform_ring_unmap(glh_uniform_ring_t *ring) {
+  if (!ring->mapped) {
+    return;
+  }
+  glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer);
+  if (ring->head > ring->mapped_offset) {
+    glFlushMappedBufferRange(GL_UNIFORM_BUFFER, 0,
+                             ring->head - ring->mapped_offset);
+  }
+  glUnmapBuffer(GL_UNIFORM_BUFFER);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  ring->mapped = NULL;
+}
+
+void glh_uniform_ring_begin_frame(glh_uniform_ring_t *ring) {
+  glh__uniform_ring_unmap(ring);
+  ring->frame = (ring->frame + 1) % ring->frame_count;
+  ring->head = 0;
+
+  GLsync fence = ring->fences[ring->frame];
+  if (!fence) {
+    return;
+  }
+  // Poll first, only a GPU running frame_count frames behind gets waited on
+  GLenum status = glClientWaitSync(fence, 0, 0);
+  if (status == GL_TIMEOUT_EXPIRED) {
+    ring->stalls++;
+    do {
+      status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    } while (status == GL_TIMEOUT_EXPIRED);
+  }
+  glDeleteSync(fence);
+  ring->fences[ring->frame] = NULL;
+}
+
+void glh_uniform_ring_end_frame(glh_uniform_ring_t *ring) {
+  glh__uniform_ring_unmap(ring);
+  if (ring->fences[ring->frame]) {
+    glDeleteSync(ring->fences[ring->frame]);
+  }
+  ring->fences[ring->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void *glh_uniform_ring_alloc(glh_uniform_ring_t *ring, uint32_t size,
+                             GLintptr *offset) {
+  uint32_t align = (uint32_t)ring->alignment;
+  uint32_t start = (ring->head + align - 1) / align * align;
+  if (size > ring->frame_size || start > ring->frame_size - size) {
+    if (!ring->overflows++) {
+      fprintf(stderr, "[GL] Uniform ring region of %u bytes is full\n",
+              ring->frame_size);
+    }
+    return NULL;
+  }
+
+  if (!ring->mapped) {
+    // Map the rest of the region. The fence in begin_frame already made sure
+    // the GPU is done with it, so no synchronization is needed from the driver
+    ring->mapped_offset = start;
+    glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer);
+    ring->mapped = (uint8_t *)glMapBufferRange(
+        GL_UNIFORM_BUFFER,
+        (GLintptr)ring->frame * ring->frame_size + start,
+        ring->frame_size - start,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+            GL_MAP_FLUSH_EXPLICIT_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    if (!ring->mapped) {
+      fprintf(stderr, "[GL] Could not map the uniform ring\n");
+      return NULL;
+    }
+  }
+
+  ring->head = start + size;
+  *offset = (GLintptr)ring->frame * ring->frame_size + start;
+  return ring->mapped + (start - ring->mapped_offset);
+}
+
+void glh_uniform_ring_bind(glh_uniform_ring_t *ring, GLuint binding,
+                           GLintptr offset, GLsizeiptr size) {
+  glh__uniform_ring_unmap(ring);
+  glBindBufferRange(GL_UNIFORM_BUFFER, binding, ring->buffer, offset, size);
+}
+
+glh_render_state_t glh_default_render_state(void) {
+  glh_render_state_t state;
+  memset(&state, 0, sizeof(state));
+  state.depth_write = true;
+  state.depth_func = GL_LESS;
+  state.blend_src = GL_ONE;
+  state.blend_dst = GL_ZERO;
+  state.cull_face = GL_BACK;
+  return state;
+}
+
+void glh_state_begin_frame(glh_state_tracker_t *tracker) {
+  tracker->changes = 0;
+  tracker->elided = 0;
+}
+
+void glh_state_reset(glh_state_tracker_t *tracker) {
+  tracker->valid = false;
+}
+
+// True when GL has to be called, counts the call or the elision
+static bool glh__state_differs(glh_state_tracker_t *tracker, bool differs) {
+  if (tracker->valid && !differs) {
+    tracker->elided++;
+    return false;
+  }
+  tracker->changes++;
+  return true;
+}
+
+static void glh__state_enable(GLenum capability, bool enable) {
+  if (enable) {
+    glEnable(capability);
+  } else {
+    glDisable(capability);
+  }
+}
+
+void glh_state_apply(glh_state_tracker_t *tracker,
+                     const glh_render_state_t *state) {
+  glh_render_state_t *current = &tracker->current;
+  if (!tracker->valid) {
+    // Unknown texture bindings, active unit and scissor box, bind every used
+    // unit and set the box the next time the test is on
+    memset(current->texture_targets, 0, sizeof(current->texture_targets));
+    memset(current->scissor_box, 0xff, sizeof(current->scissor_box));
+    tracker->active_unit = -1;
+  }
+
+  if (glh__state_differs(tracker,
+                         current->framebuffer != state->framebuffer)) {
+    glBindFramebuffer(GL_FRAMEBUFFER, state->framebuffer);
+  }
+  if (glh__state_differs(tracker, memcmp(current->viewport, state->viewport,
+                                         sizeof(state->viewport)))) {
+    glViewport(state->viewport[0], state->viewport[1], state->viewport[2],
+               state->viewport[3]);
+  }
+  if (glh__state_differs(tracker, current->scissor != state->scissor)) {
+    glh__state_enable(GL_SCISSOR_TEST, state->scissor);
+  }
+  if (state->scissor &&
+      glh__state_differs(tracker,
+                         memcmp(current->scissor_box, state->scissor_box,
+                                sizeof(state->scissor_box)))) {
+    glScissor(state->scissor_box[0], state->scissor_box[1],
+              state->scissor_box[2], state->scissor_box[3]);
+  }
+  if (glh__state_differs(tracker, current->program != state->program)) {
+    glUseProgram(state->program);
+  }
+  if (glh__state_differs(tracker, current->pipeline != state->pipeline)) {
+    glBindProgramPipeline(state->pipeline);
+  }
+  if (glh__state_differs(tracker, current->vao != state->vao)) {
+    glBindVertexArray(state->vao);
+  }
+  for (int32_t i = 0; i < GLH_MAX_TEXTURE_UNITS; ++i) {
+    if (!state->texture_targets[i]) {
+      continue;
+    }
+    if (!glh__state_differs(
+            tracker, current->texture_targets[i] != state->texture_targets[i] ||
+                         current->textures[i] != state->textures[i])) {
+      continue;
+    }
+    if (tracker->active_unit != i) {
+      glActiveTexture(GL_TEXTURE0 + i);
+      tracker->active_unit = i;
+    }
+    glBindTexture(state->texture_targets[i], state->textures[i]);
+    current->texture_targets[i] = state->texture_targets[i];
+    current->textures[i] = state->textures[i];
+  }
+  if (glh__state_differs(tracker, current->depth_test != state->depth_test)) {
+    glh__state_enable(GL_DEPTH_TEST, state->depth_test);
+  }
+  if (glh__state_differs(tracker,
+                         current->depth_write != state->depth_write)) {
+    glDepthMask(state->depth_write ? GL_TRUE : GL_FALSE);
+  }
+  if (glh__state_differs(tracker, current->depth_func != state->depth_func)) {
+    glDepthFunc(state->depth_func);
+  }
+  if (glh__state_differs(tracker, current->blend != state->blend)) {
+    glh__state_enable(GL_BLEND, state->blend);
+  }
+  if (glh__state_differs(tracker, current->blend_src != state->blend_src ||
+                                      current->blend_dst != state->blend_dst)) {
+    glBlendFunc(state->blend_src, state->blend_dst);
+  }
+  if (glh__state_differs(tracker, current->cull != state->cull)) {
+    glh__state_enable(GL_CULL_FACE, state->cull);
+  }
+  if (glh__state_differs(tracker, current->cull_face != state->cull_face)) {
+    glCullFace(state->cull_face);
+  }
+  if (glh__state_differs(tracker,
+                         memcmp(current->clear_color, state->clear_color,
+                                sizeof(state->clear_color)))) {
+    glClearColor(state->clear_color[0], state->clear_color[1],
+                 state->clear_color[2], state->clear_color[3]);
+  }
+
+  // Units the state does not care about keep what the tracker knows of them,
+  // and so does the scissor box while the test is off
+  GLenum targets[GLH_MAX_TEXTURE_UNITS];
+  GLuint textures[GLH_MAX_TEXTURE_UNITS];
+  GLint scissor_box[4];
+  memcpy(targets, current->texture_targets, sizeof(targets));
+  memcpy(textures, current->textures, sizeof(textures));
+  memcpy(scissor_box, current->scissor_box, sizeof(scissor_box));
+  *current = *state;
+  memcpy(current->texture_targets, targets, sizeof(targets));
+  memcpy(current->textures, textures, sizeof(textures));
+  if (!state->scissor) {
+    memcpy(current->scissor_box, scissor_box, sizeof(scissor_box));
+  }
+  tracker->valid = true;
+}
+
+void glh_state_use_program(glh_state_tracker_t *tracker, GLuint program) {
+  if (glh__state_differs(tracker, tracker->current.program != program)) {
+    glUseProgram(program);
+    tracker->current.program = program;
+  }
+}
+
+void glh_state_use_pipeline(glh_state_tracker_t *tracker, GLuint pipeline) {
+  glh_state_use_program(tracker, 0);
+  if (glh__state_differs(tracker, tracker->current.pipeline != pipeline)) {
+    glBindProgramPipeline(pipeline);
+    tracker->current.pipeline = pipeline;
+  }
+}
+
+GLuint glh_pipeline(glh_pipelines_t *cache, GLuint vertex_program,
+                    GLuint geometry_program, GLuint fragment_program) {
+  const GLuint stages[3] = {vertex_program, geometry_program,
+                            fragment_program};
+  for (int32_t i = 0; i < cache->count; ++i) {
+    if (!memcmp(cache->pipelines[i].stages, stages, sizeof(stages))) {
+      return cache->pipelines[i].pipeline;
+    }
+  }
+  if (cache->count == GLH_MAX_PIPELINES) {
+    fprintf(stderr, "[GL] Too many program pipelines\n");
+    return 0;
+  }
+
+  glh_pipeline_t *entry = &cache->pipelines[cache->count++];
+  memcpy(entry->stages, stages, sizeof(stages));
+  glGenProgramPipelines(1, &entry->pipeline);
+  const GLbitfield bits[3] = {GL_VERTEX_SHADER_BIT, GL_GEOMETRY_SHADER_BIT,
+                              GL_FRAGMENT_SHADER_BIT};
+  for (int32_t s = 0; s < 3; ++s) {
+    if (stages[s]) {
+      glUseProgramStages(entry->pipeline, bits[s], stages[s]);
+    }
+  }
+  return entry->pipeline;
+}
+
+void glh_pipelines_free(glh_pipelines_t *cache) {
+  for (int32_t i = 0; i < cache->count; ++i) {
+    glDeleteProgramPipelines(1, &cache->pipelines[i].pipeline);
+  }
+  cache->count = 0;
+}
+
+void glh_permutations_init(glh_permutations_t *perms, const char *cache_dir,
+                           const char *vertex_src, const char *geometry_src,
+                           const char *fragment_src,
+                           const char *const *features, int32_t feature_count,
+                           void (*setup)(glh_shader_variant_t *, void *),
+                           void *user) {
+  memset(perms, 0, sizeof(*perms));
+  perms->cache_dir = cache_dir;
+  perms->sources[0] = vertex_src;
+  perms->sources[1] = geometry_src;
+  perms->sources[2] = fragment_src;
+  if (feature_count > GLH_MAX_FEATURES) {
+    fprintf(stderr, "[GL] Only %d shader features are supported\n",
+            GLH_MAX_FEATURES);
+    feature_count = GLH_MAX_FEATURES;
+  }
+  for (int32_t i = 0; i < feature_count; ++i) {
+    perms->features[i] = features[i];
+  }
+  perms->feature_count = feature_count;
+  perms->setup = setup;
+  perms->user = user;
+}
+
+// Source with the variant's #defines between the header and the body
+static char *glh__permutation_source(const glh_permutations_t *perms,
+                                     const char *src, uint32_t features) {
+  size_t header = strlen(GLH_SHADER_HEADER);
+  if (strncmp(src, GLH_SHADER_HEADER, header)) {
+    fprintf(stderr, "[GL] Shader permutation source without header\n");
+    return NULL;
+  }
+  size_t length = strlen(src) + 1;
+  for (int32_t i = 0; i < perms->feature_count; ++i) {
+    if (features & (1u << i)) {
+      length += strlen("#define \n") + strlen(perms->features[i]);
+    }
+  }
+  char *out = (char *)malloc(length);
+  char *end = out + header;
+  memcpy(out, src, header);
+  for (int32_t i = 0; i < perms->feature_count; ++i) {
+    if (features & (1u << i)) {
+      end += sprintf(end, "#define %s\n", perms->features[i]);
+    }
+  }
+  strcpy(end, src + header);
+  return out;
+}
+
+static void glh__free_variant_sources(glh_shader_variant_t *variant) {
+  for (int32_t s = 0; s < 3; ++s) {
+    free(variant->sources[s]);
+    variant->sources[s] = NULL;
+  }
+  variant->job.vertex_src = NULL;
+  variant->job.geometry_src = NULL;
+  variant->job.fragment_src = NULL;
+}
+
+glh_shader_variant_t *glh_permutations_request(glh_permutations_t *perms,
+                                               uint32_t features) {
+  features &= (1u << perms->feature_count) - 1;
+  for (int32_t i = 0; i < perms->variant_count; ++i) {
+    if (perms->variants[i].features == features) {
+      return &perms->variants[i];
+    }
+  }
+  if (perms->variant_count == GLH_MAX_VARIANTS) {
+    fprintf(stderr, "[GL] Too many shader variants, %x not built\n",
+            features);
+    return NULL;
+  }
+
+  glh_shader_variant_t *variant = &perms->variants[perms->variant_count++];
+  memset(variant, 0, sizeof(*variant));
+  variant->features = features;
+  for (int32_t s = 0; s < 3; ++s) {
+    if (perms->sources[s]) {
+      variant->sources[s] =
+          glh__permutation_source(perms, perms->sources[s], features);
+      if (!variant->sources[s]) {
+        glh__free_variant_sources(variant);
+        variant->job.state = GLH_PROGRAM_FAILED;
+        return variant;
+      }
+    }
+  }
+  variant->job.vertex_src = variant->sources[0];
+  variant->job.geometry_src = variant->sources[1];
+  variant->job.fragment_src = variant->sources[2];
+  glh_submit_programs(perms->cache_dir, &variant->job, 1);
+  return variant;
+}
+
+glh_shader_variant_t *glh_permutations_get(glh_permutations_t *perms,
+                                           uint32_t features) {
+  glh_shader_variant_t *variant = glh_permutations_request(perms, features);
+  if (!variant || variant->ready) {
+    return variant;
+  }
+  if (variant->job.state == GLH_PROGRAM_FAILED) {
+    return NULL; // reported when it failed
+  }
+  bool failed = glh_finish_programs(&variant->job, 1) != 0;
+  glh__free_variant_sources(variant);
+  if (failed) {
+    fprintf(stderr, "[GL] Shader variant %x failed to build\n",
+            variant->features);
+    return NULL;
+  }
+  glh_reflect_program(variant->job.program, &variant->info);
+  if (perms->setup) {
+    perms->setup(variant, perms->user);
+  }
+  variant->ready = true;
+  return variant;
+}
+
+void glh_permutations_free(glh_permutations_t *perms) {
+  for (int32_t i = 0; i < perms->variant_count; ++i) {
+    glh_shader_variant_t *variant = &perms->variants[i];
+    if (!variant->ready && variant->job.state != GLH_PROGRAM_FAILED) {
+      glh_finish_programs(&variant->job, 1);
+    }
+    glh__free_variant_sources(variant);
+    glDeleteProgram(variant->job.program);
+  }
+  perms->variant_count = 0;
+}
+
+void glh_gpu_timer_init(glh_gpu_timer_t *timer) {
+  memset(timer, 0, sizeof(*timer));
+  GLint bits = 0;
+  glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+  timer->enabled = bits > 0;
+}
+
+void glh_gpu_timer_free(glh_gpu_timer_t *timer) {
+  for (int32_t i = 0; i < timer->pass_count; ++i) {
+    glDeleteQueries(2 * GLH_GPU_TIMER_FRAMES,
+                    &timer->passes[i].queries[0][0]);
+  }
+  memset(timer, 0, sizeof(*timer));
+}
+
+int32_t glh_gpu_pass(glh_gpu_timer_t *timer, const char *name) {
+  for (int32_t i = 0; i < timer->pass_count; ++i) {
+    if (!strcmp(timer->passes[i].name, name)) {
+      return i;
+    }
+  }
+  if (timer->pass_count == GLH_MAX_GPU_PASSES) {
+    fprintf(stderr, "[GL] No room for GPU pass %s\n", name);
+    return -1;
+  }
+  glh_gpu_pass_t *pass = &timer->passes[timer->pass_count];
+  memset(pass, 0, sizeof(*pass));
+  strncpy(pass->name, name, GLH_MAX_NAME_LENGTH - 1);
+  if (timer->enabled) {
+    glGenQueries(2 * GLH_GPU_TIMER_FRAMES, &pass->queries[0][0]);
+  }
+  return timer->pass_count++;
+}
+
+// Reads the pass's result in query set `frame` if the GPU has written it
+static void glh__gpu_collect(glh_gpu_pass_t *pass, int32_t frame,
+                             int64_t issued) {
+  if (!pass->pending[frame]) {
+    return;
+  }
+  // The end timestamp is written last, so its availability covers both
+  GLuint available = 0;
+  glGetQueryObjectuiv(pass->queries[frame][1], GL_QUERY_RESULT_AVAILABLE,
+                      &available);
+  if (!available) {
+    return;
+  }
+  GLuint64 begin = 0, end = 0;
+  glGetQueryObjectui64v(pass->queries[frame][0], GL_QUERY_RESULT, &begin);
+  glGetQueryObjectui64v(pass->queries[frame][1], GL_QUERY_RESULT, &end);
+  pass->history[pass->samples % GLH_GPU_TIMER_HISTORY] =
+      (double)(end - begin) * 1e-6;
+  pass->history_frame[pass->samples % GLH_GPU_TIMER_HISTORY] = issued;
+  pass->samples++;
+  pass->pending[frame] = false;
+}
+
+void glh_gpu_timer_begin_frame(glh_gpu_timer_t *timer) {
+  if (!timer->enabled) {
+    return;
+  }
+  // Oldest set first, so the history stays in submission order
+  for (int32_t i = 1; i <= GLH_GPU_TIMER_FRAMES; ++i) {
+    int32_t frame = (timer->frame + i) % GLH_GPU_TIMER_FRAMES;
+    for (int32_t p = 0; p < timer->pass_count; ++p) {
+      glh__gpu_collect(&timer->passes[p], frame, timer->issued[frame]);
+    }
+  }
+
+  timer->frame = (timer->frame + 1) % GLH_GPU_TIMER_FRAMES;
+  timer->issued[timer->frame] = timer->frames++;
+  for (int32_t p = 0; p < timer->pass_count; ++p) {
+    if (timer->passes[p].pending[timer->frame]) {
+      timer->passes[p].pending[timer->frame] = false;
+      timer->dropped++;
+    }
+  }
+}
+
+void glh_gpu_begin(glh_gpu_timer_t *timer, int32_t pass) {
+  if (timer->enabled && pass >= 0) {
+    glQueryCounter(timer->passes[pass].queries[timer->frame][0],
+                   GL_TIMESTAMP);
+  }
+}
+
+void glh_gpu_end(glh_gpu_timer_t *timer, int32_t pass) {
+  if (timer->enabled && pass >= 0) {
+    glQueryCounter(timer->passes[pass].queries[timer->frame][1],
+                   GL_TIMESTAMP);
+    timer->passes[pass].pending[timer->frame] = true;
+  }
+}
+
+static int glh__compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+int8_t glh_gpu_stats(const glh_gpu_timer_t *timer, int32_t pass,
+                     glh_gpu_stats_t *stats) {
+  memset(stats, 0, sizeof(*stats));
+  if (pass < 0 || pass >= timer->pass_count || !timer->passes[pass].samples) {
+    return 1;
+  }
+  const glh_gpu_pass_t *p = &timer->passes[pass];
+  uint32_t count = p->samples < GLH_GPU_TIMER_HISTORY ? p->samples
+                                                      : GLH_GPU_TIMER_HISTORY;
+  double sorted[GLH_GPU_TIMER_HISTORY];
+  double sum = 0.0;
+  for (uint32_t i = 0; i < count; ++i) {
+    sorted[i] = p->history[i];
+    sum += p->history[i];
+  }
+  qsort(sorted, count, sizeof(double), glh__compare_doubles);
+
+  stats->last = p->history[(p->samples - 1) % GLH_GPU_TIMER_HISTORY];
+  stats->min = sorted[0];
+  stats->avg = sum / count;
+  // Nearest rank, the sample 99% of the history is at or below
+  uint32_t rank = (uint32_t)(0.99 * count + 0.999999);
+  stats->p99 = sorted[(rank ? rank : 1) - 1];
+  stats->count = count;
+  return 0;
+}
+
+void glh_visibility_init(glh_visibility_t *visibility) {
+  memset(visibility, 0, sizeof(*visibility));
+  glGenQueries(GLH_VISIBILITY_FRAMES, visibility->queries);
+  visibility->result_frame = -1;
+  visibility->enabled = true;
+}
+
+void glh_visibility_free(glh_visibility_t *visibility) {
+  if (visibility->enabled) {
+    glDeleteQueries(GLH_VISIBILITY_FRAMES, visibility->queries);
+  }
+  memset(visibility, 0, sizeof(*visibility));
+}
+
+void glh_visibility_begin_frame(glh_visibility_t *visibility) {
+  if (!visibility->enabled) {
+    return;
+  }
+  // Every query that has a result, the newest one issued decides
+  for (int32_t i = 0; i < GLH_VISIBILITY_FRAMES; ++i) {
+    if (!visibility->pending[i]) {
+      continue;
+    }
+    GLuint available = 0;
+    glGetQueryObjectuiv(visibility->queries[i], GL_QUERY_RESULT_AVAILABLE,
+                        &available);
+    if (!available) {
+      continue;
+    }
+    GLuint passed = 0;
+    glGetQueryObjectuiv(visibility->queries[i], GL_QUERY_RESULT, &passed);
+    visibility->pending[i] = false;
+    if (visibility->issued[i] > visibility->result_frame) {
+      visibility->result_frame = visibility->issued[i];
+      visibility->visible = passed != 0;
+    }
+  }
+
+  visibility->frame = (visibility->frame + 1) % GLH_VISIBILITY_FRAMES;
+  visibility->frames++;
+  if (visibility->pending[visibility->frame]) {
+    visibility->pending[visibility->frame] = false;
+    visibility->dropped++;
+  }
+}
+
+void glh_visibility_begin(glh_visibility_t *visibility) {
+  if (visibility->enabled) {
+    glBeginQuery(GL_ANY_SAMPLES_PASSED,
+                 visibility->queries[visibility->frame]);
+  }
+}
+
+void glh_visibility_end(glh_visibility_t *visibility) {
+  if (visibility->enabled) {
+    glEndQuery(GL_ANY_SAMPLES_PASSED);
+    visibility->pending[visibility->frame] = true;
+    visibility->issued[visibility->frame] = visibility->frames;
+  }
+}
+
+bool glh_visibility_hidden(const glh_visibility_t *visibility) {
+  return visibility->enabled && visibility->result_frame >= 0 &&
+         !visibility->visible;
+}
+
 #endif /* _GL_HELPERS_IMPLEMENTATION_ */
@@ -0,0 +1,125 @@
+#ifndef _MESH_DATA_H_
+#define _MESH_DATA_H_
+
+// Binary mesh format used by data/armadillo.bin, little endian:
+//   uint32_t vertex_count
+//   uint32_t triangle_count
+//   float    vertex_data[vertex_count][6]  position xyz, normal xyz
+//   uint32_t triangles[triangle_count][3]
+
+typedef struct MeshData {
+  int32_t vertex_count;
+  int32_t triangle_count;
+  float *vertex_data;  // position (3 floats), normals (3 floats)
+  uint32_t *triangles; // 3 x triangle_count
+
+  // Vertex Layout info
+  int32_t vertex_size;
+  int32_t positions_size;
+  int32_t positions_offset;
+  int32_t normals_size;
+  int32_t normals_offset;
+} MeshData;
+
+// Both return 0 on success and EXIT_FAILURE otherwise
+int32_t load_mesh_data(const char *filename, MeshData *out_data);
+int32_t save_mesh_data(const char *filename, const MeshData *data);
+#endif /* _MESH_DATA_H_ */
+
+#ifdef _MESH_DATA_IMPLEMENTATION_
+
+int32_t load_mesh_data(const char *filename, MeshData *out_data) {
+  FILE *file = fopen(filename, "rb");
+
+  if (!file) {
+    perror("Failed to open file");
+    return EXIT_FAILURE;
+  }
+
+  if (fread(&out_data->vertex_count, sizeof(uint32_t), 1, file) != 1) {
+    perror("Failed to read vertex count");
+    fclose(file);
+    return EXIT_FAILURE;
+  }
+
+  // Read triangle count (1 byte)
+  if (fread(&out_data->triangle_count, sizeof(uint32_t), 1, file) != 1) {
+    perror("Failed to read triangle count");
+    fclose(file);
+    return EXIT_FAILURE;
+  }
+
+  // Allocate memory for vertex data
+  out_data->vertex_size = 6 * sizeof(float);
+  size_t vertex_data_size = out_data->vertex_count * out_data->vertex_size;
+  out_data->vertex_data = (float *)malloc(vertex_data_size);
+  if (!out_data->vertex_data) {
+    perror("Failed to allocate memory for vertices");
+    fclose(file);
+    return EXIT_FAILURE;
+  }
+
+  // Read vertex data
+  if (fread(out_data->vertex_data, 1, vertex_data_size, file) !=
+      vertex_data_size) {
+    perror("Failed to read vertex data");
+    free(out_data->vertex_data);
+    fclose(file);
+    return EXIT_FAILURE;
+  }
+
+  // Allocate memory for triangle data
+  size_t triangle_data_size = out_data->triangle_count * 3 * sizeof(uint32_t);
+  out_data->triangles = (uint32_t *)malloc(triangle_data_size);
+  if (!out_data->triangles) {
+    perror("Failed to allocate memory for triangles");
+    free(out_data->vertex_data);
+    fclose(file);
+    return EXIT_FAILURE;
+  }
+
+  // Read triangle data
+  if (fread(out_data->triangles, 1, triangle_data_size, file) !=
+      triangle_data_size) {
+    perror("Failed to read triangle data");
+    free(out_data->vertex_data);
+    free(out_data->triangles);
+    fclose(file);
+    return EXIT_FAILURE;
+  }
+
+  // Close the file
+  fclose(file);
+  out_data->positions_size = 3 * sizeof(float);
+  out_data->positions_offset = 0;
+  out_data->normals_size = 3 * sizeof(float);
+  out_data->normals_offset = 3 * sizeof(float);
+  return 0;
+}
+
+int32_t save_mesh_data(const char *filename, const MeshData *data) {
+  FILE *file = fopen(filename, "wb");
+
+  if (!file) {
+    perror("Failed to open file");
+    return EXIT_FAILURE;
+  }
+
+  size_t vertex_floats = (size_t)data->vertex_count * 6;
+  size_t triangle_indices = (size_t)data->triangle_count * 3;
+  if (fwrite(&data->vertex_count, sizeof(uint32_t), 1, file) != 1 ||
+      fwrite(&data->triangle_count, sizeof(uint32_t), 1, file) != 1 ||
+      fwrite(data->vertex_data, sizeof(float), vertex_floats, file) !=
+          vertex_floats ||
+      fwrite(data->triangles, sizeof(uint32_t), triangle_indices, file) !=
+          triangle_indices) {
+    perror("Failed to write mesh data");
+    fclose(file);
+    return EXIT_FAILURE;
+  }
+
+  fclose(file);
+  return 0;
+}
+
+#endif /* _MESH_DATA_IMPLEMENTATION_ */
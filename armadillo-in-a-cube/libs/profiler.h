@@ -0,0 +1,332 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+// Instrumenting CPU profiler. Zones are bracketed with PROF_BEGIN / PROF_END,
+// or one statement is wrapped in PROF_ZONE like GLCHECK. They are recorded
+// into a buffer owned by the calling thread, so recording a zone takes no
+// lock and no atomic read-modify-write: two timestamps (rdtsc on x86) and one
+// store. A thread's buffer is allocated the first time it records and linked
+// into the global list with a single compare-and-swap. prof_write_chrome_trace
+// writes the zones of every thread as Chrome trace-event JSON, which
+// chrome://tracing and ui.perfetto.dev open.
+//
+//   PROF_INIT();
+//   PROF_BEGIN("update");
+//   ...
+//   PROF_END();
+//   PROF_ZONE("swap", glfwSwapBuffers(window));
+//   PROF_WRITE_TRACE("trace.json");
+//
+// Everything is compiled out unless PROF_ENABLED is 1: the macros expand to
+// the bare statement or to nothing, and no code or thread-local storage is
+// left. Zone names are stored by pointer, so use string literals.
+// PROF_GL_BEGIN / PROF_GL_END also push a GL debug group (KHR_debug, see
+// glh_push_debug_group in gl_helpers.h), so graphics debuggers show the same
+// zones around the GL calls.
+#ifndef PROF_ENABLED
+#define PROF_ENABLED 0
+#endif
+
+#if PROF_ENABLED
+
+#ifndef PROF_MAX_EVENTS
+#define PROF_MAX_EVENTS (1 << 16) // closed zones kept per thread
+#endif
+#define PROF_MAX_DEPTH 32 // deeper zones are not recorded
+
+typedef struct prof_event {
+  const char *name;
+  uint64_t start; // ticks, see prof_ticks
+  uint64_t end;
+} prof_event_t;
+
+typedef struct prof_thread {
+  struct prof_thread *next;
+  uint32_t id;
+  const char *name;
+  uint32_t count;   // recorded events, published with release semantics
+  uint32_t dropped; // zones lost to a full buffer or PROF_MAX_DEPTH
+  uint32_t depth;   // open zones
+  const char *open_names[PROF_MAX_DEPTH];
+  uint64_t open_starts[PROF_MAX_DEPTH];
+  prof_event_t events[PROF_MAX_EVENTS];
+} prof_thread_t;
+
+// Records the tick origin of the trace, call once before any zone
+void prof_init(void);
+// Names the calling thread in the trace
+void prof_thread_name(const char *name);
+void prof_begin(const char *name);
+void prof_end(void);
+// Forgets the zones the calling thread recorded so far
+void prof_clear(void);
+// Raw timestamp: TSC ticks on x86, nanoseconds elsewhere
+uint64_t prof_ticks(void);
+// Writes every thread's zones, returns 1 when the file cannot be written.
+// Zones recorded while it runs may or may not be included.
+int8_t prof_write_chrome_trace(const char *path);
+// Frees every thread's buffer, no thread may record afterwards
+void prof_shutdown(void);
+
+#define PROF_INIT() prof_init()
+#define PROF_THREAD_NAME(name) prof_thread_name(name)
+#define PROF_BEGIN(name) prof_begin(name)
+#define PROF_END() prof_end()
+#define PROF_ZONE(name, x)                                                     \
+  do {                                                                         \
+    prof_begin(name);                                                          \
+    x;                                                                         \
+    prof_end();                                                                \
+  } while (0)
+#define PROF_GL_BEGIN(name)                                                    \
+  do {                                                                         \
+    prof_begin(name);                                                          \
+    glh_push_debug_group(name);                                                \
+  } while (0)
+#define PROF_GL_END()                                                          \
+  do {                                                                         \
+    glh_pop_debug_group();                                                     \
+    prof_end();                                                                \
+  } while (0)
+#define PROF_WRITE_TRACE(path) prof_write_chrome_trace(path)
+#define PROF_SHUTDOWN() prof_shutdown()
+
+#else
+
+#define PROF_INIT() ((void)0)
+#define PROF_THREAD_NAME(name) ((void)0)
+#define PROF_BEGIN(name) ((void)0)
+#define PROF_END() ((void)0)
+#define PROF_ZONE(name, x)                                                     \
+  do {                                                                         \
+    x;                                                                         \
+  } while (0)
+#define PROF_GL_BEGIN(name) ((void)0)
+#define PROF_GL_END() ((void)0)
+#define PROF_WRITE_TRACE(path) ((void)0)
+#define PROF_SHUTDOWN() ((void)0)
+
+#endif /* PROF_ENABLED */
+#endif /* _PROFILER_H_ */
+
+#if defined(_PROFILER_IMPLEMENTATION_) && PROF_ENABLED
+
+#if defined(_WIN32) || defined(_WIN64)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <intrin.h>
+#define PROF__THREAD_LOCAL __declspec(thread)
+#define prof__cas_pointer(target, expected, desired)                           \
+  (InterlockedCompareExchangePointer((PVOID volatile *)(target), (desired),   \
+                                     (expected)) == (expected))
+#define prof__fetch_add(target, value)                                         \
+  ((uint32_t)InterlockedExchangeAdd((LONG volatile *)(target), (LONG)(value)))
+// x86 and x64 stores already have release semantics, only the compiler
+// must not reorder them
+#define prof__store_release(target, value)                                     \
+  do {                                                                         \
+    _ReadWriteBarrier();                                                       \
+    *(volatile uint32_t *)(target) = (value);                                  \
+  } while (0)
+#define prof__load_acquire(target) (*(volatile uint32_t *)(target))
+#define prof__load_pointer(target) (*(void *volatile *)(target))
+#else
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#define PROF__THREAD_LOCAL _Thread_local
+#define prof__cas_pointer(target, expected, desired)                           \
+  __atomic_compare_exchange_n((target), &(expected), (desired), false,         \
+                              __ATOMIC_RELEASE, __ATOMIC_RELAXED)
+#define prof__fetch_add(target, value)                                         \
+  __atomic_fetch_add((target), (value), __ATOMIC_RELAXED)
+#define prof__store_release(target, value)                                     \
+  __atomic_store_n((target), (value), __ATOMIC_RELEASE)
+#define prof__load_acquire(target) __atomic_load_n((target), __ATOMIC_ACQUIRE)
+#define prof__load_pointer(target) __atomic_load_n((target), __ATOMIC_ACQUIRE)
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) ||             \
+    defined(__i386__)
+#define PROF__TSC 1
+#else
+#define PROF__TSC 0
+#endif
+
+static prof_thread_t *prof__threads; // every thread that recorded, newest first
+static uint32_t prof__thread_count;
+static PROF__THREAD_LOCAL prof_thread_t *prof__self;
+static uint64_t prof__origin_ticks;
+static double prof__origin_ns;
+
+static double prof__now_ns(void) {
+#if defined(_WIN32) || defined(_WIN64)
+  static LARGE_INTEGER frequency;
+  LARGE_INTEGER counter;
+  if (!frequency.QuadPart) {
+    QueryPerformanceFrequency(&frequency);
+  }
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart * 1e9 / (double)frequency.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+uint64_t prof_ticks(void) {
+#if PROF__TSC
+  return __rdtsc();
+#else
+  return (uint64_t)prof__now_ns();
+#endif
+}
+
+void prof_init(void) {
+  prof__origin_ns = prof__now_ns();
+  prof__origin_ticks = prof_ticks();
+}
+
+// Slow path of the first zone on a thread: allocate and publish its buffer
+static prof_thread_t *prof__register(void) {
+  prof_thread_t *thread = (prof_thread_t *)calloc(1, sizeof(prof_thread_t));
+  if (!thread) {
+    fprintf(stderr, "[PROF] Could not allocate a thread buffer\n");
+    exit(-1);
+  }
+  thread->id = prof__fetch_add(&prof__thread_count, 1);
+  for (;;) {
+    prof_thread_t *head = (prof_thread_t *)prof__load_pointer(&prof__threads);
+    thread->next = head;
+    if (prof__cas_pointer(&prof__threads, head, thread)) {
+      break;
+    }
+  }
+  prof__self = thread;
+  return thread;
+}
+
+void prof_thread_name(const char *name) {
+  prof_thread_t *thread = prof__self ? prof__self : prof__register();
+  thread->name = name;
+}
+
+void prof_begin(const char *name) {
+  prof_thread_t *thread = prof__self ? prof__self : prof__register();
+  uint32_t depth = thread->depth++;
+  if (depth < PROF_MAX_DEPTH) {
+    thread->open_names[depth] = name;
+    thread->open_starts[depth] = prof_ticks(); // last, so setup is not timed
+  }
+}
+
+void prof_end(void) {
+  uint64_t end = prof_ticks(); // first, so bookkeeping is not timed
+  prof_thread_t *thread = prof__self;
+  if (!thread || !thread->depth) {
+    return; // unbalanced PROF_END
+  }
+  uint32_t depth = --thread->depth;
+  uint32_t count = thread->count;
+  if (depth >= PROF_MAX_DEPTH || count == PROF_MAX_EVENTS) {
+    thread->dropped++;
+    return;
+  }
+  prof_event_t *event = &thread->events[count];
+  event->name = thread->open_names[depth];
+  event->start = thread->open_starts[depth];
+  event->end = end;
+  // The writer only reads events below count
+  prof__store_release(&thread->count, count + 1);
+}
+
+void prof_clear(void) {
+  if (prof__self) {
+    prof__store_release(&prof__self->count, 0);
+  }
+}
+
+// JSON string, names are literals but may still contain quotes
+static void prof__write_string(FILE *file, const char *string) {
+  fputc('"', file);
+  for (const char *c = string ? string : "?"; *c; ++c) {
+    if (*c == '"' || *c == '\\') {
+      fputc('\\', file);
+      fputc(*c, file);
+    } else if ((unsigned char)*c < 0x20) {
+      fprintf(file, "\\u%04x", (unsigned char)*c);
+    } else {
+      fputc(*c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+int8_t prof_write_chrome_trace(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    fprintf(stderr, "[PROF] Could not write %s\n", path);
+    return 1;
+  }
+
+  // Ticks per microsecond, measured over the whole run so far
+  double elapsed_us = (prof__now_ns() - prof__origin_ns) * 1e-3;
+  double ticks_per_us = 1e3;
+  if (PROF__TSC && elapsed_us > 0.0) {
+    ticks_per_us = (double)(prof_ticks() - prof__origin_ticks) / elapsed_us;
+  }
+
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  bool first = true;
+  uint32_t dropped = 0;
+  for (prof_thread_t *thread =
+           (prof_thread_t *)prof__load_pointer(&prof__threads);
+       thread; thread = thread->next) {
+    if (thread->name) {
+      fprintf(file,
+              "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,"
+              "\"tid\":%u,\"args\":{\"name\":",
+              first ? "" : ",\n", thread->id);
+      prof__write_string(file, thread->name);
+      fprintf(file, "}}");
+      first = false;
+    }
+    uint32_t count = prof__load_acquire(&thread->count);
+    for (uint32_t i = 0; i < count; ++i) {
+      const prof_event_t *event = &thread->events[i];
+      fprintf(file, "%s{\"ph\":\"X\",\"cat\":\"cpu\",\"name\":",
+              first ? "" : ",\n");
+      prof__write_string(file, event->name);
+      fprintf(file, ",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+              thread->id,
+              (double)(int64_t)(event->start - prof__origin_ticks) /
+                  ticks_per_us,
+              (double)(event->end - event->start) / ticks_per_us);
+      first = false;
+    }
+    dropped += thread->dropped;
+  }
+  fprintf(file, "\n]}\n");
+  fclose(file);
+
+  if (dropped) {
+    fprintf(stderr, "[PROF] %u zones did not fit the buffers of %s\n",
+            dropped, path);
+  }
+  return 0;
+}
+
+void prof_shutdown(void) {
+  prof_thread_t *thread = prof__threads;
+  while (thread) {
+    prof_thread_t *next = thread->next;
+    free(thread);
+    thread = next;
+  }
+  prof__threads = NULL;
+  prof__self = NULL; // only the calling thread's, the others must be done
+}
+
+#endif /* _PROFILER_IMPLEMENTATION_ && PROF_ENABLED */
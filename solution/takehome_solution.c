@@ -3,6 +3,9 @@
 #define _GLFW_IMPLEMENTATION_
 #define _GL_HELPERS_IMPLEMENTATION_
 #define _VEC_MATH_IMPLEMENTATION_
+#define _MESH_DATA_IMPLEMENTATION_
+#define _PROFILER_IMPLEMENTATION_
+#define _BENCH_IMPLEMENTATION_
 
 // Detect OS
 #define PLATFORM_WINDOWS 0
@@ -53,34 +56,278 @@
 #include "libs/glad.h"
 #include "libs/gl_helpers.h"
 #include "libs/vec_math.h"
+#include "libs/mesh_data.h"
+#include "libs/profiler.h" // Zones compile to nothing unless built with -DPROF_ENABLED=1
+#include "libs/bench.h"    // Statistics, JSON/CSV output and baseline comparison of the scene suite
 
 #define WINDOW_WIDTH 800
 #define WINDOW_HEIGHT 600
+#define SHADER_CACHE_DIR "shader_cache" // Linked program binaries, safe to delete
+#define TRACE_FILE "trace.json" // CPU zones of the run, for chrome://tracing (with PROF_ENABLED)
+#define HEADLESS_FRAMES 600     // Frames a --headless run renders unless --frames says otherwise
+#define HEADLESS_WARMUP 10      // Leading frames left out of the frame time statistics
+#define FIXED_TIMESTEP (1.0 / 60.0) // Animation step of a --headless run, in seconds
+#define MAX_CUBES 1024          // Most textured cubes a scene can have
+#define SUITE_THRESHOLD 5.0     // Percent a scenario may get slower than the baseline
+#define FRAME_DATA_BINDING 0 // Uniform buffer binding point of the FrameData block
+#define DRAW_DATA_BINDING 1  // Uniform buffer binding point of the DrawData block
+#define FACE_DATA_BINDING 2  // Uniform buffer binding point of the FaceData block
+#define CUBE_FACES 6         // Layers of the offscreen target with --faces, one per cube face
+#define FRAMES_IN_FLIGHT 3   // Frames the CPU may run ahead before reusing draw data memory
+#define MAX_DRAWS_PER_FRAME 4096 // Size of each frame's region of the draw data ring
+#define MODEL_ZOOM 0.4f      // w of the armadillo's world position, smaller draws it bigger
+#define TARGET_MIN_SIZE 64    // Smallest offscreen target picked from the cube's size, texels per side
+#define TARGET_CLASSES 6      // Power of two target sizes from TARGET_MIN_SIZE up, 2048 at most
+#define TARGET_SHRINK_FRAMES 60 // Frames a smaller target must do before the offscreen pass switches to it
+#define TARGET_MAX_BUFFERS 3   // Color buffers per offscreen target, one more than the largest latency
+#define TARGET_LATENCY 1       // Default frames the cubes' texture lags behind the armadillo's render
+#define TARGET_NEVER INT64_MIN // Frame stamp of a buffer nothing was rendered to
+#define ATLAS_BUDGET_MB 256   // Default memory the rotation atlas may take
+#define MODEL_SPEED 0.5f      // Radians per second the armadillo turns around the X-axis
+#define CACHE_MAX_TEXELS 2.0f // Texels the cached armadillo may lag behind, about a pixel on the cube
+
+// Frame-global data shared by every program, uploaded once per frame. The layout is std140:
+// every vec3 starts on 16 bytes, so the float after it fills the last 4 bytes of the slot.
+// The camera and light are folded into each draw's DrawData on the CPU, prepare_draw_data,
+// the shaders only read the fields that stay the same in every space.
+typedef struct FrameData {
+    mat4_t view;       // Camera view matrix
+    mat4_t projection; // Camera projection matrix
+    vec3_t light_pos;  // Light position in world space
+    float time;        // Seconds since start, sampled once per frame
+    vec3_t light_color;
+    float pad0;
+    vec3_t view_pos;   // Camera position in world space
+    float pad1;
+} FrameData;
+
+// The same block in GLSL, placed right after GLH_SHADER_HEADER in every shader
+#define FRAME_DATA_BLOCK_SRC                                                      \
+    GLH_STRINGIFY(                                                                \
+    layout(std140) uniform FrameData {                                            \
+        mat4 view;                                                                \
+        mat4 projection;                                                          \
+        vec3 lightPos;                                                            \
+        float time;                                                               \
+        vec3 lightColor;                                                          \
+        float pad0;                                                               \
+        vec3 viewPos;                                                             \
+        float pad1;                                                               \
+    };                                                                            \
+    )
+
+// Per-draw data, one block per draw call streamed through the uniform ring. std140 as well:
+// a mat3 is three vec4 columns, hence the vec4_t array. Every matrix and the light are
+// computed once per draw by prepare_draw_data, so the vertex shaders only multiply. Lighting
+// happens in view space, where the camera sits at the origin. Block members share the global
+// GLSL namespace, hence viewLightPos next to FrameData's lightPos.
+typedef struct DrawData {
+    mat4_t model_view;        // Model space to view space, for lighting
+    mat4_t mvp;               // Model space to clip space
+    vec4_t normal_matrix[3];  // Inverse transpose of model_view's upper 3x3, one column per vec4
+    vec3_t light_pos;         // Light position in view space
+    float roughness;          // Material roughness (used in PBR)
+    vec3_t object_color;      // Material base color
+    float metalness;          // Material metalness (used in PBR)
+} DrawData;
+
+#define DRAW_DATA_BLOCK_SRC                                                       \
+    GLH_STRINGIFY(                                                                \
+    layout(std140) uniform DrawData {                                             \
+        mat4 modelView;                                                           \
+        mat4 mvp;                                                                 \
+        mat3 normalMatrix;                                                        \
+        vec3 viewLightPos;                                                        \
+        float roughness;                                                          \
+        vec3 objectColor;                                                         \
+        float metalness;                                                          \
+    };                                                                            \
+    )
+
+// Cameras of the six cube faces for --faces, in the order of cube_vertices. Every face looks at
+// the armadillo from outside that face, so the geometry stage renders all of them in one draw,
+// one invocation and layer each. Neither the cameras nor the light move, the block is written
+// once. The zoom is folded into the view-projections, which take world positions with w 1
+typedef struct FaceData {
+    mat4_t views[CUBE_FACES];            // World space to each face's view space, for lighting
+    mat4_t view_projections[CUBE_FACES]; // World space to each face's clip space, zoom included
+    vec4_t light_pos[CUBE_FACES];        // The frame's light in each face's view space, w unused
+} FaceData;
+
+#define FACE_DATA_BLOCK_SRC                                                       \
+    GLH_STRINGIFY(                                                                \
+    layout(std140) uniform FaceData {                                             \
+        mat4 faceViews[6];                                                        \
+        mat4 faceViewProjections[6];                                              \
+        vec4 faceLightPos[6];                                                     \
+    };                                                                            \
+    )
+
+// Lighting terms of the armadillo shader, each one a #define in its own shader variant. A
+// material only gets the terms it needs, see material_features
+enum {
+    MATERIAL_AMBIENT = 1 << 0,   // Constant low-level illumination
+    MATERIAL_DIFFUSE = 1 << 1,   // Lambertian reflectance
+    MATERIAL_SPECULAR = 1 << 2,  // Blinn-Phong highlight
+    MATERIAL_METALNESS = 1 << 3, // Albedo and highlight blended by metalness
+    MODEL_FACE_LAYERS = 1 << 4,  // Lit by the light of the face the geometry stage picked, --faces
+};
+
+const char* material_feature_names[] = {
+    "MATERIAL_AMBIENT", "MATERIAL_DIFFUSE", "MATERIAL_SPECULAR", "MATERIAL_METALNESS", "FACE_LAYERS",
+};
+
+// Variants of the cube shader, the offscreen texture unless ROTATION_ATLAS or FACE_LAYERS is defined
+enum {
+    CUBE_ROTATION_ATLAS = 1 << 0, // Samples the pre-rendered rotations, see init_rotation_atlas
+    CUBE_FACE_LAYERS = 1 << 1,    // Samples the layer of each face, see init_face_data
+};
+
+const char* cube_feature_names[] = {
+    "ROTATION_ATLAS", "FACE_LAYERS",
+};
+
+// Draws of one frame, their blocks are written together before any of them is issued
+enum {
+    DRAW_MODEL, // Armadillo into the offscreen texture
+    DRAW_CUBE,  // Textured cubes on screen, one block per cube in cube_offsets
+    DRAW_COUNT,
+};
+
+// Size of the scene. The default is the regular app, the benchmark suite scales one at a time
+typedef struct SceneConfig {
+    const char* name;       // Scenario name in the suite results
+    int32_t width;          // Window resolution
+    int32_t height;
+    int32_t texture_width;  // Offscreen target resolution, 0 picks it from the cube's size on screen
+    int32_t texture_height;
+    int32_t cubes;          // Textured cubes on screen, laid out in a grid
+    float triangles;        // Fraction of the armadillo's triangles drawn, in (0, 1]
+} SceneConfig;
+
+const SceneConfig default_config = {"default", WINDOW_WIDTH, WINDOW_HEIGHT, 0, 0, 1, 1.0f};
+
+// Offscreen render target of one size. The armadillo renders to one color buffer while the cubes
+// sample another one finished in an earlier frame, so the GPU does not have to finish the first
+// pass before it starts the second. The buffers share the depth buffer, only the model pass uses it
+typedef struct OffscreenTarget {
+    int32_t width;  // 0 until the target is first used
+    int32_t height;
+    GLuint framebuffers[TARGET_MAX_BUFFERS];
+    GLuint textures[TARGET_MAX_BUFFERS];   // Color, with mip levels
+    int64_t rendered[TARGET_MAX_BUFFERS];  // Frame of each buffer's last render, TARGET_NEVER before
+    bool mips_stale[TARGET_MAX_BUFFERS];   // Rendered to since its mip levels were generated
+    GLint drawn[TARGET_MAX_BUFFERS][4];    // Box each buffer's last render drew into, background outside
+    GLuint depth_buffer;  // Renderbuffer, 0 with face layers
+    GLuint depth_texture; // Layered depth with face layers, a layered framebuffer cannot use a renderbuffer
+} OffscreenTarget;
+
+// When the offscreen armadillo is re-rendered. In between, the cubes sample the texture of the last
+// render. Only the model matrix can make it stale, the camera, light and material never change.
+// With both thresholds 0 it is re-rendered on every frame it moved
+typedef struct CachePolicy {
+    float max_angle;  // Radians it may turn before it is re-rendered, 0 ignores the angle
+    float max_texels; // Texels any of its points may move before it is re-rendered, 0 ignores them
+    float max_rate;   // Re-renders per second at most, 0 for no cap
+} CachePolicy;
+
+const CachePolicy default_cache_policy = {0.0f, CACHE_MAX_TEXELS, 0.0f};
 
 // Basic datastructures
 typedef struct SceneData {
+    SceneConfig config;     // Resolutions and amount of geometry
+    int32_t model_indices;  // Indices of the armadillo drawn, from config.triangles
+    float model_radius;     // Distance of its farthest vertex from its origin, in object space
+    vec3_t model_min;       // Its bounding box in object space, bounds it on the offscreen target
+    vec3_t model_max;
     GLuint cube_vao;
-    GLuint basic_program;
+    GLuint cube_vertex;   // Separable vertex stage of the cube
+    GLuint cube_fragment; // Separable fragment stage of the cube, the variant of cube_shaders in use
+    glh_permutations_t cube_shaders; // Cube fragment stage variants, with or without the atlas
     GLuint model_vao;
-    GLuint model_program;
-    GLuint framebuffer;
-    GLuint texture;
+    GLuint model_vertex;  // Separable vertex stage of the armadillo, shared by every variant
+    GLuint model_geometry; // Separable geometry stage of --faces, one invocation per cube face
+    glh_permutations_t model_shaders; // Armadillo fragment stage variants, built when a material needs them
+    glh_pipelines_t pipelines; // Stage combinations, created the first time a draw uses them
+
+    // Offscreen targets. A fixed texture size only uses targets[0], otherwise there is one per power
+    // of two size class, created the first time the cubes' size on screen needs it and then kept
+    OffscreenTarget targets[TARGET_CLASSES];
+    int32_t target;         // Target the armadillo is rendered to and the cubes sample
+    int32_t target_classes; // Size classes the driver supports, from GL_MAX_TEXTURE_SIZE
+    int32_t shrink_class;   // Largest smaller class the last shrink_frames frames wanted
+    int32_t shrink_frames;  // Frames in a row a smaller target would have done
+    uint32_t target_switches; // Times the target changed after startup
+    int32_t target_latency; // Frames the sampled buffer is at least behind the newest render
+    int32_t write_buffer;   // Buffer of the target the armadillo renders to this frame
+    int32_t read_buffer;    // Buffer the cubes sample this frame
+    bool model_scissor;     // Clear and draw only the armadillo's box on the target
+    GLint model_box[4];     // Box around the armadillo on the target this frame, x, y, width, height
+    double scissor_area;    // Fractions of the target the renders cleared, summed over the run
+
+    // Frame-global uniforms, one buffer bound at FRAME_DATA_BINDING for all programs
+    GLuint frame_ubo;
+    FrameData frame_data;
+
+    // Face layers. Each target buffer is an array with a layer per cube face, rendered in one draw
+    // with the cameras of FaceData bound at FACE_DATA_BINDING, and each face samples its own layer
+    bool face_layers;
+    GLuint face_ubo;
+
+    // Per-draw uniforms, FRAMES_IN_FLIGHT regions bound at DRAW_DATA_BINDING one range at a time
+    glh_uniform_ring_t draw_ring;
+    GLintptr draw_offsets[DRAW_COUNT]; // Offsets of this frame's blocks in the ring
+    GLintptr cube_offsets[MAX_CUBES];  // Offsets of every cube's block, DRAW_CUBE has the first
+    GLuint draw_pipelines[DRAW_COUNT]; // Pipeline of each draw, with the variant its material needs
+
+    // Render state of both passes, built in init_render_states. use_offscreen_target,
+    // init_rotation_atlas, select_target_buffers and scissor_model_pass retarget them between
+    // applies (framebuffer, viewport, scissor box, the cube's texture). The tracker diffs against
+    // what it last set, so only what differs from the previous pass reaches GL
+    glh_state_tracker_t state;
+    glh_render_state_t model_pass;
+    glh_render_state_t cube_pass;
+
+    // GPU time of both passes, read back a few frames late so timing never stalls the pipeline
+    glh_gpu_timer_t gpu_timer;
+    int32_t model_timer; // render_model
+    int32_t cube_timer;  // frame
+    int32_t frame_timer; // Both passes, the GPU time of a whole frame
+
+    // Rotation atlas. The armadillo's spin is periodic, so atlas_layers evenly spaced angles of one
+    // turn are rendered once at startup and the cubes sample them instead of the offscreen pass
+    GLuint atlas_texture;   // GL_TEXTURE_2D_ARRAY, one angle per layer
+    int32_t atlas_layers;   // 0 renders the armadillo every frame instead
+    bool atlas_blend;       // Blend the two nearest angles instead of taking the nearest
+    float atlas_lookup[3];  // Layers nearest to this frame's angle and the weight of the second
+    double atlas_ms;        // Startup cost of rendering every layer, GPU included
+    double atlas_mb;        // Memory of the layers and their mip levels
+
+    // Offscreen armadillo cache, render_model only runs on frames that set model_stale
+    CachePolicy cache_policy;
+    bool cache_valid;     // The texture holds a render of cached_model
+    bool model_stale;     // This frame re-renders the texture
+    mat4_t cached_model;  // Model matrix of the last render
+    float cached_time;    // Scene time of the last render
+    uint32_t model_renders; // Frames that re-rendered the texture
+    uint32_t model_skips;   // Frames that reused it
+    glh_visibility_t cube_visibility; // Whether the cube pass drew any sample, read back a frame or more late
+    uint32_t model_hidden;  // Frames the render was skipped because no cube was visible
+
+    // Animation clock. With a fixed timestep the time of frame n is n * timestep, so every run
+    // renders the same images no matter how fast it goes
+    double timestep;      // Seconds per frame, 0 follows the wall clock
+    uint32_t frame_index; // Frames rendered so far
+
+    // Reflected uniforms of the cube fragment stage and their handles, resolved once in
+    // init_uniforms. Every variant keeps its own in its permutations, this points at the cube's
+    glh_program_info_t* basic_info;
+    struct {
+        int32_t texture;
+        int32_t atlas_lookup; // Only in the ROTATION_ATLAS variant
+    } basic_uniforms;
 } SceneData;
 
-typedef struct MeshData {
-    int32_t vertex_count;
-    int32_t triangle_count;
-    float* vertex_data; // position (3 floats), normals (3 floats)
-    uint32_t* triangles; // 3 x triangle_count
-
-    // Vertex Layout info
-    int32_t vertex_size;
-    int32_t positions_size;
-    int32_t positions_offset;
-    int32_t normals_size;
-    int32_t normals_offset;
-} MeshData;
-
 float cube_vertices[] = {
 		// positions          // normals           // texture coords
 		// Back face
@@ -135,6 +382,7 @@ float cube_vertices[] = {
 // Shaders for cube
 const char* cube_vrtx_shdr_src =
     GLH_SHADER_HEADER
+    DRAW_DATA_BLOCK_SRC
     GLH_STRINGIFY(
     // Vertex Shader Input Attributes
     // `aPos` is the position of the vertex.
@@ -144,58 +392,73 @@ const char* cube_vrtx_shdr_src =
     // `aTexCoords` are the texture coordinates for the vertex.
     layout (location = 2) in vec2 aTexCoords;
 
-    // Output to the fragment shader
-    // `FragPos` is the transformed position of the vertex in world space.
-    out vec3 FragPos;
+    // Output to the fragment shader, matched by location since the stages are separate programs
+    // `FragPos` is the transformed position of the vertex in view space.
+    layout (location = 0) out vec3 FragPos;
     // `Normal` is the transformed normal vector.
-    out vec3 Normal;
+    layout (location = 1) out vec3 Normal;
     // `TexCoords` are the texture coordinates passed to the fragment shader.
-    out vec2 TexCoords;
+    layout (location = 2) out vec2 TexCoords;
+    // Separable vertex stages have to redeclare the built-in outputs they write.
+    out gl_PerVertex { vec4 gl_Position; };
 
-    // Uniforms used for transformations
-    // `model` is the model matrix that transforms vertex positions from model space to world space.
-    uniform mat4 model;
-    // `view` is the view matrix that transforms vertices from world space to camera space.
-    uniform mat4 view;
-    // `projection` is the projection matrix that transforms vertices from camera space to screen space.
-    uniform mat4 projection;
+    // Transformations
+    // `modelView`, `mvp` and `normalMatrix` come from the DrawData block, computed once per draw on the CPU.
 
     void main()
     {
-        // Transform vertex position from model space to world space using the model matrix.
-        FragPos = vec3(model * vec4(aPos, 1.0));
+        // Transform vertex position from model space to view space.
+        FragPos = vec3(modelView * vec4(aPos, 1.0));
 
-        // Transform the normal vector from model space to world space using the model matrix.
-        // `transpose(inverse(model))` is used to correctly transform normals.
-        Normal = mat3(transpose(inverse(model))) * aNormal;
+        // Transform the normal vector to view space.
+        // `normalMatrix` is the inverse transpose of the model-view matrix, so no vertex inverts anything.
+        Normal = normalMatrix * aNormal;
 
         // Pass texture coordinates to the fragment shader.
         TexCoords = aTexCoords;
 
         // Calculate the final position of the vertex in clip space.
-        // `projection * view * vec4(FragPos, 1.0)` transforms the vertex position through view and projection matrices.
-        gl_Position = projection * view * vec4(FragPos, 1.0);
+        gl_Position = mvp * vec4(aPos, 1.0);
     }
 );
 
 const char* cube_frag_shdr_src =
     GLH_SHADER_HEADER
+    DRAW_DATA_BLOCK_SRC
     GLH_STRINGIFY(
 
     // Output color of the fragment.
     out vec4 FragColor;
 
-    // Inputs from the vertex shader.
-    // `FragPos` is the position of the fragment in world space.
-    in vec3 FragPos;
+    // Inputs from the vertex shader, matched by location.
+    // `FragPos` is the position of the fragment in view space.
+    layout (location = 0) in vec3 FragPos;
     // `Normal` is the normal vector at the fragment.
-    in vec3 Normal;
+    layout (location = 1) in vec3 Normal;
     // `TexCoords` is the texture coordinate of the fragment.
-    in vec2 TexCoords;
+    layout (location = 2) in vec2 TexCoords;
 
     // Uniforms for textures and lighting.
+    )
+    "\n#ifdef ROTATION_ATLAS\n"
+    GLH_STRINGIFY(
+    // `simple_texture` holds the armadillo pre-rendered at evenly spaced angles, one per layer.
+    // `atlasLookup` has the two layers nearest to the current angle and the weight of the second.
+    uniform sampler2DArray simple_texture;
+    uniform vec3 atlasLookup;
+    )
+    "\n#elif defined(FACE_LAYERS)\n"
+    GLH_STRINGIFY(
+    // `simple_texture` holds the armadillo seen from each face, one layer per face.
+    uniform sampler2DArray simple_texture;
+    )
+    "\n#else\n"
+    GLH_STRINGIFY(
     // `simple_texture` is the texture sampler for the object's texture.
     uniform sampler2D simple_texture;
+    )
+    "\n#endif\n"
+    GLH_STRINGIFY(
 
     void main()
     {
@@ -203,8 +466,8 @@ const char* cube_frag_shdr_src =
         vec3 norm = normalize(Normal);
 
         // Compute the direction of the light relative to the fragment position.
-        // Here, a directional light is positioned at (1.0, 1.0, 1.0).
-        vec3 lightDir = normalize(vec3(1.0, 1.0, 1.0) - FragPos);
+        // `viewLightPos` is the cube's light at (1.0, 1.0, 1.0) in world space, moved to view space per draw.
+        vec3 lightDir = normalize(viewLightPos - FragPos);
 
         // Calculate the diffuse lighting component.
         // `diff` is the dot product between the normal and light direction, clamped to zero.
@@ -215,7 +478,27 @@ const char* cube_frag_shdr_src =
         vec3 ambient = vec3(1.0, 1.0, 1.0); // White ambient light
         
         // Sample the texture color at the given texture coordinates.
+    )
+    "\n#ifdef ROTATION_ATLAS\n"
+    GLH_STRINGIFY(
+        // From the nearest layer, blended with the next one when it has a weight.
+        vec4 texColor = texture(simple_texture, vec3(TexCoords, atlasLookup.x));
+        if (atlasLookup.z > 0.0) {
+            texColor = mix(texColor, texture(simple_texture, vec3(TexCoords, atlasLookup.y)), atlasLookup.z);
+        }
+    )
+    "\n#elif defined(FACE_LAYERS)\n"
+    GLH_STRINGIFY(
+        // From the layer of this face. Every cube is a draw of its own, two triangles per face in
+        // the order of the layers, so the primitive's index in the draw gives the face.
+        vec4 texColor = texture(simple_texture, vec3(TexCoords, float(gl_PrimitiveID / 2)));
+    )
+    "\n#else\n"
+    GLH_STRINGIFY(
         vec4 texColor = texture(simple_texture, TexCoords);
+    )
+    "\n#endif\n"
+    GLH_STRINGIFY(
 
         // Combine the ambient and diffuse lighting with the texture color.
         // `0.8` is the alpha value for the final color (opacity).
@@ -229,6 +512,7 @@ const char* cube_frag_shdr_src =
 // Shaders for model
 const char* model_vrtx_shdr_src =
     GLH_SHADER_HEADER
+    DRAW_DATA_BLOCK_SRC
     GLH_STRINGIFY(
 
     // Vertex Shader Input Attributes
@@ -238,104 +522,176 @@ const char* model_vrtx_shdr_src =
     // `aNormal` is the normal vector at the vertex, with layout location 1.
     layout(location = 1) in vec3 aNormal; // Normal attribute
 
-    // Outputs to the fragment shader
-    // `FragPos` is the position of the fragment in world space.
-    out vec3 FragPos;  // Position of the fragment in world space
+    // Outputs to the fragment shader, matched by location since the stages are separate programs
+    // `FragPos` is the position of the fragment in view space.
+    layout(location = 0) out vec3 FragPos;  // Position of the fragment in view space
 
     // `Normal` is the normal vector at the fragment, used for lighting calculations.
-    out vec3 Normal;   // Normal of the fragment
+    layout(location = 1) out vec3 Normal;   // Normal of the fragment
+
+    // Separable vertex stages have to redeclare the built-in outputs they write.
+    out gl_PerVertex { vec4 gl_Position; };
 
-    // Uniforms used for transformations
-    // `model` matrix transforms vertex positions from model space to world space.
-    // `view` matrix transforms vertices from world space to camera (view) space.
-    // `projection` matrix transforms vertices from camera space to screen space.
-    uniform mat4 model;       // Model matrix
-    uniform mat4 view;        // View matrix
-    uniform mat4 projection;  // Projection matrix
+    // Transformations
+    // `modelView`, `mvp` and `normalMatrix` come from the DrawData block, computed once per draw on the CPU.
 
     void main()
     {
-        // Transform the vertex position from model space to world space.
-        FragPos = vec3(model * vec4(aPos, 1.0));
+        // Transform the vertex position from model space to view space.
+        FragPos = vec3(modelView * vec4(aPos, 1.0));
 
-        // Transform the normal vector from model space to world space.
-        // `transpose(inverse(model))` adjusts normals for correct lighting in world space.
-        Normal = mat3(transpose(inverse(model))) * aNormal;  
+        // Transform the normal vector to view space.
+        // `normalMatrix` is the inverse transpose of the model-view matrix, so no vertex inverts anything.
+        Normal = normalMatrix * aNormal;
 
         // Calculate the final position of the vertex in clip space.
-        // Applying the projection matrix after the view matrix determines the final screen position.
-        // Adjusting `vec4(FragPos, 0.4)` scales the position, affecting the zoom level.
-        gl_Position = projection * view * vec4(FragPos, 0.4); // zoom
+        // The zoom (MODEL_ZOOM as the w of the world position) is part of `mvp`.
+        gl_Position = mvp * vec4(aPos, 1.0);
+    }
+);
+
+// Geometry stage of --faces. The vertex stage ran with an identity view, so its outputs are in world
+// space. Each of the six invocations moves the triangle to one face's view and clip space and
+// sends it to that face's layer
+const char* model_geom_shdr_src =
+    GLH_SHADER_HEADER
+    FACE_DATA_BLOCK_SRC
+    GLH_STRINGIFY(
+
+    // One invocation per cube face, each emits its copy of the triangle.
+    layout(triangles, invocations = 6) in;
+    layout(triangle_strip, max_vertices = 3) out;
+
+    // Separable stages have to redeclare the built-in blocks they use.
+    in gl_PerVertex { vec4 gl_Position; } gl_in[];
+    out gl_PerVertex { vec4 gl_Position; };
+
+    // Inputs from the vertex shader in world space, matched by location.
+    layout(location = 0) in vec3 WorldPos[];
+    layout(location = 1) in vec3 WorldNormal[];
+
+    // Outputs to the fragment shader in the face's view space.
+    layout(location = 0) out vec3 FragPos;
+    layout(location = 1) out vec3 Normal;
+    // `FaceLightPos` is the light in the face's view space, the same for the whole triangle.
+    layout(location = 3) flat out vec3 FaceLightPos;
+
+    void main()
+    {
+        int face = gl_InvocationID;
+        for (int i = 0; i < 3; ++i) {
+            // The views are orthonormal (some mirrored), their upper 3x3 moves the normals as well.
+            FragPos = vec3(faceViews[face] * vec4(WorldPos[i], 1.0));
+            Normal = mat3(faceViews[face]) * WorldNormal[i];
+            FaceLightPos = faceLightPos[face].xyz;
+            gl_Position = faceViewProjections[face] * vec4(WorldPos[i], 1.0);
+            gl_Layer = face;
+            EmitVertex();
+        }
+        EndPrimitive();
     }
 );
 
 const char* model_frag_shdr_src =
     GLH_SHADER_HEADER
+    FRAME_DATA_BLOCK_SRC
+    DRAW_DATA_BLOCK_SRC
     GLH_STRINGIFY(
     
     // Output color of the fragment.
     out vec4 FragColor;
-    // Inputs from the vertex shader.
-    // `FragPos` is the position of the fragment in world space.
-    in vec3 FragPos;
+    // Inputs from the vertex shader, matched by location.
+    // `FragPos` is the position of the fragment in view space.
+    layout(location = 0) in vec3 FragPos;
     // `Normal` is the normal vector at the fragment.
-    in vec3 Normal;
+    layout(location = 1) in vec3 Normal;
     // `TexCoord` is the texture coordinate of the fragment (not used in this shader).
-    in vec2 TexCoord;
-
-    // Uniforms for lighting and material properties.
-    // `lightPos` is the position of the light source in world space.
-    uniform vec3 lightPos;
-    // `viewPos` is the position of the camera/viewer in world space.
-    uniform vec3 viewPos;
-    // `lightColor` is the color of the light source.
-    uniform vec3 lightColor;
-    // `objectColor` is the base color of the object.
-    uniform vec3 objectColor;
-    // `roughness` and `metalness` control the material properties for PBR.
-    uniform float roughness;
-    uniform float metalness;
+    layout(location = 2) in vec2 TexCoord;
+    )
+    "\n#ifdef FACE_LAYERS\n"
+    GLH_STRINGIFY(
+    // `FaceLightPos` is the light in the view space of the face being rendered, from the geometry stage.
+    layout(location = 3) flat in vec3 FaceLightPos;
+    )
+    "\n#endif\n"
+    GLH_STRINGIFY(
+
+    // Material properties come from the DrawData block: `objectColor` is the base color of the
+    // object, `roughness` and `metalness` control the material properties for PBR.
+    // `viewLightPos` is the light in view space, also from DrawData. `lightColor` comes from the FrameData block.
+    // Each lighting term is compiled in only when its MATERIAL_* feature is defined, preprocessor
+    // lines need their own line, hence the strings between the stringified parts.
 
     void main()
     {
+        // Start from black and add the terms this variant has.
+        vec3 result = vec3(0.0);
+        // Albedo is the base color of the object.
+        vec3 albedo = objectColor;
+    )
+    "\n#ifdef MATERIAL_METALNESS\n"
+    GLH_STRINGIFY(
+        // Simple Physically Based Rendering (PBR) approximation: metals have less diffuse color.
+        albedo *= 1.0 - metalness;
+    )
+    "\n#endif\n"
+    "#ifdef MATERIAL_AMBIENT\n"
+    GLH_STRINGIFY(
+        // Ambient lighting contribution (constant low-level illumination), adjusted by albedo.
+        result += 0.1 * lightColor * albedo;
+    )
+    "\n#endif\n"
+    "#if defined(MATERIAL_DIFFUSE) || defined(MATERIAL_SPECULAR)\n"
+    GLH_STRINGIFY(
         // Normalize the normal vector for proper lighting calculations.
         vec3 norm = normalize(Normal);
-        // Calculate the direction from the fragment to the viewer (camera).
-        vec3 viewDir = normalize(viewPos - FragPos);
+    )
+    "\n#ifdef FACE_LAYERS\n"
+    GLH_STRINGIFY(
+        // Calculate the direction from the fragment to the light source, in the face's view space.
+        vec3 lightDir = normalize(FaceLightPos - FragPos);
+    )
+    "\n#else\n"
+    GLH_STRINGIFY(
         // Calculate the direction from the fragment to the light source.
-        vec3 lightDir = normalize(lightPos - FragPos);
+        vec3 lightDir = normalize(viewLightPos - FragPos);
+    )
+    "\n#endif\n"
+    "#endif\n"
+    "#ifdef MATERIAL_DIFFUSE\n"
+    GLH_STRINGIFY(
+        // Diffuse lighting contribution based on the Lambertian reflectance model, adjusted by albedo.
+        float diff = max(dot(norm, lightDir), 0.0);
+        result += diff * lightColor * albedo;
+    )
+    "\n#endif\n"
+    "#ifdef MATERIAL_SPECULAR\n"
+    GLH_STRINGIFY(
+        // Calculate the direction from the fragment to the viewer (camera), at the origin of view space.
+        vec3 viewDir = normalize(-FragPos);
         // Calculate the half-vector between the view direction and the light direction.
         vec3 halfDir = normalize(viewDir + lightDir);
-
-        // Ambient lighting contribution (constant low-level illumination).
-        vec3 ambient = 0.1 * lightColor;
-
-        // Diffuse lighting contribution based on the Lambertian reflectance model.
-        float diff = max(dot(norm, lightDir), 0.0);
-        vec3 diffuse = diff * lightColor;
-
         // Specular lighting contribution using the Blinn-Phong reflection model.
         // `pow(max(dot(norm, halfDir), 0.5), 64.0)` controls the shininess.
         float spec = pow(max(dot(norm, halfDir), 0.5), 64.0);
         vec3 specular = spec * lightColor;
-
-        // Simple Physically Based Rendering (PBR) approximation:
-        // Albedo is the base color of the object, adjusted for metalness.
-        vec3 albedo = objectColor * (1.0 - metalness);
-        vec3 ambientColor = ambient * albedo; // Adjust ambient color based on albedo.
-        vec3 diffuseColor = diffuse * albedo; // Adjust diffuse color based on albedo.
-        vec3 specularColor = specular * metalness; // Adjust specular color based on metalness.
-
-        // Combine ambient, diffuse, and specular components to get the final color.
-        vec3 result = ambientColor + diffuseColor + specularColor;
+    )
+    "\n#ifdef MATERIAL_METALNESS\n"
+    GLH_STRINGIFY(
+        // Metals reflect more, adjust the specular color based on metalness.
+        specular *= metalness;
+    )
+    "\n#endif\n"
+    GLH_STRINGIFY(
+        result += specular;
+    )
+    "\n#endif\n"
+    GLH_STRINGIFY(
         // Set the output fragment color with full opacity.
         FragColor = vec4(result, 1.0);
     }
 );
 
-// Implementation of data loading, out of the way
-int32_t load_mesh_data(const char* filename, MeshData* out_data);
-
 // Initialize cube function - called once, sets up data for rendering
 void init_cube(SceneData* scene){
     
@@ -375,14 +731,6 @@ void init_cube(SceneData* scene){
     glBindBuffer(GL_ARRAY_BUFFER, 0); 
     // Unbind the VAO (optional)
     glBindVertexArray(0);
-
-    // Compile shaders and link the shader program
-    // Compile vertex shader
-    GLuint vrtx_shdr = glh_compile_shader_src(GL_VERTEX_SHADER, cube_vrtx_shdr_src);
-    // Compile fragment shader
-    GLuint frag_shdr = glh_compile_shader_src(GL_FRAGMENT_SHADER, cube_frag_shdr_src);
-    // Link shaders into a program
-    scene->basic_program = glh_link_program(vrtx_shdr, 0, frag_shdr);
 }
 
 // Initialize model function - called once, sets up data for rendering
@@ -418,259 +766,1222 @@ void init_model(SceneData* scene, MeshData* mesh_data) {
     // stride = `mesh_data->vertex_size`, offset = `mesh_data->normals_offset`
     glEnableVertexAttribArray(1);  // Enable the normal attribute
 
+    // Draw a prefix of the triangles when the scene asks for fewer, whole triangles only
+    scene->model_indices = (int32_t)(mesh_data->triangle_count * scene->config.triangles) * 3;
+
+    // Bounding sphere around the origin, it bounds how far a rotation moves the armadillo's texels.
+    // The bounding box bounds where it lands on the offscreen target
+    scene->model_radius = 0.0f;
+    scene->model_min = vec3(INFINITY, INFINITY, INFINITY);
+    scene->model_max = vec3(-INFINITY, -INFINITY, -INFINITY);
+    for (int32_t i = 0; i < mesh_data->vertex_count; ++i) {
+        const float* position = (const float*)((const char*)mesh_data->vertex_data +
+                                                i * mesh_data->vertex_size + mesh_data->positions_offset);
+        scene->model_radius = fmaxf(scene->model_radius, vec3_norm(vec3(position[0], position[1], position[2])));
+        scene->model_min = vec3(fminf(scene->model_min.x, position[0]), fminf(scene->model_min.y, position[1]),
+                                fminf(scene->model_min.z, position[2]));
+        scene->model_max = vec3(fmaxf(scene->model_max.x, position[0]), fmaxf(scene->model_max.y, position[1]),
+                                fmaxf(scene->model_max.z, position[2]));
+    }
+
     // Unbind the buffers
     // Unbind the VBO (optional)
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     // Unbind the VAO (optional)
     glBindVertexArray(0);
+}
 
-    // Compile shaders and link the shader program
-    // Compile vertex shader
-    GLuint vrtx_shdr = glh_compile_shader_src(GL_VERTEX_SHADER, model_vrtx_shdr_src);  
-    // Compile fragment shader
-    GLuint frag_shdr = glh_compile_shader_src(GL_FRAGMENT_SHADER, model_frag_shdr_src);  
-    // Link shaders into a program and store its ID in `scene->model_program`
-    scene->model_program = glh_link_program(vrtx_shdr, 0, frag_shdr);
-}
-
-void set_texture(SceneData* scene) {
-    // Define light and material properties
-    vec3_t lightPos = vec3(0.0f, 1.0f, 2.0f);  // Position of the light in world space
-    vec3_t lightColor = vec3(1.0f, 1.0f, 1.0f);  // Color of the light (white)
-    vec3_t objectColor = vec3(0.6f, 1.0f, 0.3f);  // Color of the object/material
-    float ambientStrength = 0.5f;  // Strength of the ambient light component
-    float roughness = 0.5f;  // Roughness factor for the material (used in PBR)
-    float metalness = 0.5f;  // Metalness factor for the material (used in PBR)
-
-    // Pass light properties to the fragment shader
-    // Get the location of the uniform variables in the fragment shader
-    GLint lightPosLoc = glGetUniformLocation(scene->model_program, "lightPos");
-    GLint lightColorLoc = glGetUniformLocation(scene->model_program, "lightColor");
-    GLint objectColorLoc = glGetUniformLocation(scene->model_program, "objectColor");
-    GLint ambientStrengthLoc = glGetUniformLocation(scene->model_program, "ambientStrength");
-    GLint roughnessLoc = glGetUniformLocation(scene->model_program, "roughness");
-    GLint metalnessLoc = glGetUniformLocation(scene->model_program, "metalness");
-
-    // Set the values of the uniform variables
-    glUniform3fv(lightPosLoc, 1, (const GLfloat*)&lightPos);  // Pass the light position as a vec3
-    glUniform3fv(lightColorLoc, 1, (const GLfloat*)&lightColor);  // Pass the light color as a vec3
-    glUniform3fv(objectColorLoc, 1, (const GLfloat*)&objectColor);  // Pass the object color as a vec3
-    glUniform1f(ambientStrengthLoc, ambientStrength);  // Pass the ambient light strength as a float
-    glUniform1f(roughnessLoc, roughness);  // Pass the roughness value as a float
-    glUniform1f(metalnessLoc, metalness);  // Pass the metalness value as a float
+// Bind the uniform blocks of a stage program to the shared binding points
+void bind_uniform_blocks(const glh_program_info_t* info) {
+    // Every stage reads FrameData, DrawData and FaceData from the same binding points, a stage
+    // program only has the blocks its own stage uses
+    if ((glh_uniform_block(info, "FrameData") >= 0 &&
+         glh_bind_uniform_block(info, "FrameData", FRAME_DATA_BINDING, sizeof(FrameData))) ||
+        (glh_uniform_block(info, "DrawData") >= 0 &&
+         glh_bind_uniform_block(info, "DrawData", DRAW_DATA_BINDING, sizeof(DrawData))) ||
+        (glh_uniform_block(info, "FaceData") >= 0 &&
+         glh_bind_uniform_block(info, "FaceData", FACE_DATA_BINDING, sizeof(FaceData)))) {
+        fprintf(stderr, "[ERROR] Uniform blocks do not match the C layout!\n");
+        exit(EXIT_FAILURE);
+    }
 }
 
-void init_texture(SceneData* scene, MeshData* mesh) {
-    // Generate and bind the framebuffer object (FBO)
-    glGenFramebuffers(1, &scene->framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, scene->framebuffer);
-
-    // Generate and configure the texture for color attachment
-    glGenTextures(1, &scene->texture);
-    glBindTexture(GL_TEXTURE_2D, scene->texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, WINDOW_WIDTH, WINDOW_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-
-    // Set texture parameters for filtering and wrapping
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
-
-    // Attach the texture to the framebuffer's color attachment point
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, scene->texture, 0);
-
-    // Create and configure the depth buffer
-    GLuint depth_buffer;
-    glGenRenderbuffers(1, &depth_buffer);
-    glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, WINDOW_WIDTH, WINDOW_HEIGHT);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_buffer);
+// Cube fragment variant: the rotation atlas, the face layers or the single offscreen texture
+uint32_t cube_features(int32_t atlas_layers, bool face_layers) {
+    return atlas_layers ? CUBE_ROTATION_ATLAS : face_layers ? CUBE_FACE_LAYERS : 0;
+}
 
-    // Check if the framebuffer is complete and ready for rendering
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        fprintf(stderr, "Framebuffer is not complete!\n");
+// Reflect the fixed stage programs and resolve uniform handles - called once, after they are linked
+void init_uniforms(SceneData* scene) {
+    glh_program_info_t vertex_info; // Only needed for the block bindings
+    glh_reflect_program(scene->cube_vertex, &vertex_info);
+    bind_uniform_blocks(&vertex_info);
+    glh_reflect_program(scene->model_vertex, &vertex_info);
+    bind_uniform_blocks(&vertex_info);
+    if (scene->model_geometry) {
+        glh_reflect_program(scene->model_geometry, &vertex_info);
+        bind_uniform_blocks(&vertex_info);
     }
 
-    // Set the viewport to match the size of the texture
-    glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+    // The cube variant was requested with the other programs, its blocks are bound in setup_variant
+    glh_shader_variant_t* variant =
+        glh_permutations_get(&scene->cube_shaders, cube_features(scene->atlas_layers, scene->face_layers));
+    if (!variant) {
+        fprintf(stderr, "[ERROR] Failed to build the cube shader variant!\n");
+        exit(EXIT_FAILURE);
+    }
+    scene->cube_fragment = variant->job.program;
+    scene->basic_info = &variant->info;
+    scene->basic_uniforms.texture = glh_uniform(scene->basic_info, "simple_texture");
+    scene->basic_uniforms.atlas_lookup = glh_uniform(scene->basic_info, "atlasLookup");
+}
 
-    // Clear the framebuffer (color and depth buffers)
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+// Set up a shader variant - called once per variant, after it is linked and reflected
+void setup_variant(glh_shader_variant_t* variant, void* user) {
+    (void)user;
+    bind_uniform_blocks(&variant->info);
+}
 
-    // Set up the camera and transformation matrices
+// Lighting terms a material needs. Metalness 0 has no highlight, metalness 1 has no albedo
+uint32_t material_features(const DrawData* draw) {
+    uint32_t features = 0;
+    if (draw->metalness < 1.0f) {
+        features |= MATERIAL_AMBIENT | MATERIAL_DIFFUSE;
+    }
+    if (draw->metalness > 0.0f) {
+        features |= MATERIAL_SPECULAR | MATERIAL_METALNESS;
+    }
+    return features;
+}
+
+// Pipeline of the armadillo for a material: the shared vertex stage and the material's fragment
+// variant, with face layers the geometry stage too. The variant is built the first time the
+// material shows up, the pairing costs no link
+GLuint material_pipeline(SceneData* scene, const DrawData* draw) {
+    uint32_t features = material_features(draw) | (scene->face_layers ? MODEL_FACE_LAYERS : 0);
+    glh_shader_variant_t* variant = glh_permutations_get(&scene->model_shaders, features);
+    if (!variant) {
+        fprintf(stderr, "[ERROR] Failed to build the armadillo shader variant!\n");
+        exit(EXIT_FAILURE);
+    }
+    return glh_pipeline(&scene->pipelines, scene->model_vertex, scene->model_geometry, variant->job.program);
+}
+
+// Animation time of the current frame, in seconds
+float scene_time(const SceneData* scene) {
+    if (scene->timestep > 0.0) {
+        return (float)(scene->frame_index * scene->timestep);
+    }
+    return (float)glfwGetTime();
+}
+
+// Initialize frame data - called once, computes the camera and light and creates the buffer
+void init_frame_data(SceneData* scene) {
+    FrameData* frame = &scene->frame_data;
     vec3_t eye = vec3(0.0f, 0.0f, 3.0f); // Camera position
     vec3_t center = vec3(0.0f, 0.0f, 0.0f); // Point the camera is looking at
     vec3_t up = vec3(0.0f, 1.0f, 0.0f); // Up direction for the camera
 
-    // Use the shader program for rendering
-    glUseProgram(scene->model_program);
-
-    // Create rotation matrices based on time
-    float angle = (float)glfwGetTime() * 0.5f; // Rotation angle (changes over time)
-    vec3_t axis = vec3(0.7071068f, 0.7071068f, 0.0f); // Rotation axis (normalized)
-    mat4_t model = mat4_make_rotation(axis, angle); // Model matrix for rotation
-    mat4_t view = look_at(eye, center, up); // View matrix
-    mat4_t projection = perspective(deg2rad(45.0f), (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT, 0.1f, 100.0f); // Projection matrix
-
-    // Set the matrices as uniforms in the shader
-    GLuint model_loc = glGetUniformLocation(scene->model_program, "model");
-    GLuint view_loc = glGetUniformLocation(scene->model_program, "view");
-    GLuint proj_loc = glGetUniformLocation(scene->model_program, "projection");
-
-    glUniformMatrix4fv(model_loc, 1, GL_FALSE, (const GLfloat*)&model);
-    glUniformMatrix4fv(view_loc, 1, GL_FALSE, (const GLfloat*)&view);
-    glUniformMatrix4fv(proj_loc, 1, GL_FALSE, (const GLfloat*)&projection);
-
-    // Set the clear color and use the shader program
-    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-    glUseProgram(scene->model_program);
-
-    // Bind the texture and render the model
-    set_texture(scene);
-    glBindVertexArray(scene->model_vao);
-    glDrawElements(GL_TRIANGLES, mesh->triangle_count * 3, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    // The camera does not move, so the matrices are computed once here instead of every pass
+    frame->view = look_at(eye, center, up);
+    frame->projection = perspective(deg2rad(45.0f), (float)scene->config.width / (float)scene->config.height, 0.1f, 100.0f);
+    frame->light_pos = vec3(0.0f, 1.0f, 2.0f); // Position of the light in world space
+    frame->light_color = vec3(1.0f, 1.0f, 1.0f); // Color of the light (white)
+    frame->view_pos = eye;
+    frame->time = scene_time(scene);
+
+    // Create the buffer and bind it to its binding point for good
+    glGenBuffers(1, &scene->frame_ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, scene->frame_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), frame, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, scene->frame_ubo);
+}
 
-    // Unbind the framebuffer to return to default framebuffer (the screen)
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+// View of a camera at eye with the given axes, like look_at but the axes may form a mirrored basis
+mat4_t face_view(vec3_t right, vec3_t up, vec3_t back, vec3_t eye) {
+    const vec3_t axes[3] = {right, up, back};
+    mat4_t view = mat4_identity();
+    for (int32_t row = 0; row < 3; ++row) {
+        for (int32_t col = 0; col < 3; ++col) {
+            view.data[col * 4 + row] = axes[row].data[col];
+        }
+        view.data[12 + row] = -vec3_dot(eye, axes[row]);
+    }
+    return view;
+}
+
+// Initialize the face cameras - called once after init_frame_data with --faces. Each face's camera
+// sits as far out along its normal as the main one and looks at the center. Its right and up are
+// the directions the face's texture coordinates u and v grow in (dP/du and dP/dv of the face's
+// first triangle), so the texture shows on the face the way the camera saw it. The back, right
+// and top faces have their texture mirrored as seen from outside, their views are mirrored to
+// match; nothing is culled, so the flipped winding does not matter. The front face shows what the
+// single texture would. The buffer is bound at FACE_DATA_BINDING for good
+void init_face_data(SceneData* scene) {
+    const FrameData* frame = &scene->frame_data;
+    float distance = vec3_norm(frame->view_pos);
+    mat4_t zoom = mat4_identity();
+    zoom.data[15] = MODEL_ZOOM; // The w of the world position, as prepare_draw_data does
+    FaceData faces;
+    for (int32_t i = 0; i < CUBE_FACES; ++i) {
+        // Every vertex is a position, a normal and texture coordinates: 8 floats, 6 per face
+        const float* v = &cube_vertices[i * 6 * 8];
+        vec3_t edge1 = vec3(v[8] - v[0], v[9] - v[1], v[10] - v[2]);
+        vec3_t edge2 = vec3(v[16] - v[0], v[17] - v[1], v[18] - v[2]);
+        float du1 = v[14] - v[6], dv1 = v[15] - v[7];
+        float du2 = v[22] - v[6], dv2 = v[23] - v[7];
+        float det = du1 * dv2 - du2 * dv1;
+        vec3_t dp_du = vec3_scalar_div(vec3_sub(vec3_scalar_mul(edge1, dv2), vec3_scalar_mul(edge2, dv1)), det);
+        vec3_t dp_dv = vec3_scalar_div(vec3_sub(vec3_scalar_mul(edge2, du1), vec3_scalar_mul(edge1, du2)), det);
+        vec3_t normal = vec3(v[3], v[4], v[5]);
+        vec3_t eye = vec3_scalar_mul(normal, distance);
+        faces.views[i] = face_view(vec3_normalize(dp_du), vec3_normalize(dp_dv), normal, eye);
+        faces.view_projections[i] = mat4_mul(mat4_mul(frame->projection, faces.views[i]), zoom);
+        vec3_t light = mat4_vec3_mul(faces.views[i], frame->light_pos, 1);
+        faces.light_pos[i] = vec4(light.x, light.y, light.z, 1.0f);
+    }
 
+    glGenBuffers(1, &scene->face_ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, scene->face_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FaceData), &faces, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FACE_DATA_BINDING, scene->face_ubo);
 }
 
-// Frame function - called on every frame, performs the rendering
-void frame(SceneData* scene, MeshData* mesh_data) {
-    // Clear the screen and set the background color
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glClearColor(0.3f, 0.3f, 0.45f, 1.0f); // Set the clear color to a dark blue
+// Update frame data - called once per frame, a single upload serves every program and pass
+void update_frame_data(SceneData* scene) {
+    scene->frame_data.time = scene_time(scene);
+    glBindBuffer(GL_UNIFORM_BUFFER, scene->frame_ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &scene->frame_data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
 
-    // Define the camera and view parameters
-    vec3_t eye = vec3(0.0f, 0.0f, 3.0f); // Camera position
-    vec3_t center = vec3(0.0f, 0.0f, 0.0f); // Point the camera is looking at
-    vec3_t up = vec3(0.0f, 1.0f, 0.0f); // Up direction for the camera
+// Initialize draw data - called once, creates the ring the per-draw blocks are streamed through
+void init_draw_data(SceneData* scene) {
+    // Every block starts on the offset alignment, so that is what one draw really takes
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    uint32_t block_size = (sizeof(DrawData) + alignment - 1) / alignment * alignment;
+
+    if (glh_uniform_ring_init(&scene->draw_ring, MAX_DRAWS_PER_FRAME * block_size, FRAMES_IN_FLIGHT)) {
+        fprintf(stderr, "[ERROR] Failed to create the draw data ring!\n");
+        exit(EXIT_FAILURE);
+    }
+}
 
-    // Use the shader program for rendering the cube
-    glUseProgram(scene->basic_program);
+// Copy one draw's block into the current frame's region, returns its offset in the ring
+GLintptr push_draw_data(SceneData* scene, const DrawData* draw) {
+    GLintptr offset = 0;
+    void* block = glh_uniform_ring_alloc(&scene->draw_ring, sizeof(DrawData), &offset);
+    if (block) {
+        memcpy(block, draw, sizeof(DrawData)); // Write-only memory, so copy instead of filling in place
+    }
+    return offset;
+}
 
-    // Create rotation matrices for the cube
-    float angle = (float)glfwGetTime() * 0.15f; // Rotation angle (changes over time)
-    vec3_t axis = vec3(0.7071068f, 0.7071068f, 0.0f); // Rotation axis (normalized)
-    mat4_t model = mat4_make_rotation(axis, angle); // Model matrix for rotation
-    mat4_t view = look_at(eye, center, up); // View matrix for camera
-    mat4_t projection = perspective(deg2rad(45.0f), (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT, 0.1f, 100.0f); // Projection matrix
+// Point the DrawData block of the next draw at a block pushed this frame
+void bind_draw_data(SceneData* scene, GLintptr offset) {
+    glh_uniform_ring_bind(&scene->draw_ring, DRAW_DATA_BINDING, offset, sizeof(DrawData));
+}
 
-    // Set uniform variables in the shader program
-    GLuint model_loc = glGetUniformLocation(scene->basic_program, "model");
-    GLuint view_loc = glGetUniformLocation(scene->basic_program, "view");
-    GLuint proj_loc = glGetUniformLocation(scene->basic_program, "projection");
-    GLuint textureLoc = glGetUniformLocation(scene->basic_program, "simple_texture");
+// Decide whether the offscreen armadillo has to be re-rendered with this frame's model matrix
+bool model_cache_stale(const SceneData* scene, mat4_t model) {
+    if (!scene->cache_valid) {
+        return true; // Nothing rendered by the loop yet
+    }
 
-    glUniformMatrix4fv(model_loc, 1, GL_FALSE, (const GLfloat*)&model); // Set the model matrix
-    glUniformMatrix4fv(view_loc, 1, GL_FALSE, (const GLfloat*)&view); // Set the view matrix
-    glUniformMatrix4fv(proj_loc, 1, GL_FALSE, (const GLfloat*)&projection); // Set the projection matrix
-    glUniform1i(textureLoc, 0); // Set texture unit 0
+    // A rotation by angle moves a unit vector by at most 2 sin(angle / 2), and the squared difference
+    // of two rotation matrices is twice the square of that distance
+    float difference = 0.0f;
+    for (int32_t column = 0; column < 3; ++column) {
+        for (int32_t row = 0; row < 3; ++row) {
+            float d = model.data[column * 4 + row] - scene->cached_model.data[column * 4 + row];
+            difference += d * d;
+        }
+    }
+    float chord = sqrtf(difference * 0.5f);
+    if (chord == 0.0f) {
+        return false; // It did not move
+    }
+    const CachePolicy* policy = &scene->cache_policy;
+    if (policy->max_rate > 0.0f && (scene->frame_data.time - scene->cached_time) * policy->max_rate < 0.999f) {
+        return false; // Rendered too recently, with some slack for the rounding of the frame times
+    }
+    if (policy->max_angle <= 0.0f && policy->max_texels <= 0.0f) {
+        return true;
+    }
 
-    // Render the cube
-    glBindVertexArray(scene->cube_vao); // Bind the VAO for the cube
-    glBindTexture(GL_TEXTURE_2D, scene->texture); // Bind the texture for the cube
-    glDrawArrays(GL_TRIANGLES, 0, 36); // Draw the cube (assuming 36 vertices for a cube)
-    glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
-    glBindVertexArray(0); // Unbind the VAO
+    // Texels the farthest point moves: its world distance projected at the near side of the bounding
+    // sphere, where the perspective enlarges it most. A camera inside the sphere always re-renders
+    float radius = scene->model_radius / MODEL_ZOOM;
+    float distance = vec3_norm(scene->frame_data.view_pos) - radius;
+    float texels = distance > 0.0f ? chord * radius * scene->frame_data.projection.data[5] / distance *
+                                     0.5f * (float)scene->targets[scene->target].height : INFINITY;
+    float angle = 2.0f * asinf(fminf(chord * 0.5f, 1.0f));
+    return (policy->max_angle > 0.0f && angle >= policy->max_angle) ||
+           (policy->max_texels > 0.0f && texels >= policy->max_texels);
 }
 
-void render_model(SceneData* scene, MeshData* mesh) {
-    // Bind the framebuffer object (FBO) to render to it
-    glBindFramebuffer(GL_FRAMEBUFFER, scene->framebuffer);
+// Size of a target: the fixed one of the scene, or the square of a size class
+void offscreen_target_size(const SceneData* scene, int32_t index, int32_t* width, int32_t* height) {
+    *width = scene->config.texture_width ? scene->config.texture_width : TARGET_MIN_SIZE << index;
+    *height = scene->config.texture_height ? scene->config.texture_height : TARGET_MIN_SIZE << index;
+}
+
+// Create the render target of a size class, or the single one of a fixed size
+void init_offscreen_target(SceneData* scene, int32_t index) {
+    OffscreenTarget* target = &scene->targets[index];
+    offscreen_target_size(scene, index, &target->width, &target->height);
+
+    // Create and configure the depth buffer, shared by every color buffer. Face layers need a layer
+    // of depth per face, which only a texture array has
+    GLenum type = scene->face_layers ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+    if (scene->face_layers) {
+        glGenTextures(1, &target->depth_texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, target->depth_texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, target->width, target->height, CUBE_FACES, 0,
+                     GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    } else {
+        glGenRenderbuffers(1, &target->depth_buffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, target->depth_buffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, target->width, target->height);
+    }
+
+    // One framebuffer per color buffer, latency + 1 of them
+    for (int32_t i = 0; i < scene->target_latency + 1; ++i) {
+        // Generate and bind the framebuffer object (FBO)
+        glGenFramebuffers(1, &target->framebuffers[i]);
+        glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffers[i]);
+
+        // Generate and configure the texture for color attachment, an array of a layer per face with
+        // face layers. The cube faces are smaller than the texture most of the time, so it is sampled
+        // through mip levels generated after each render
+        glGenTextures(1, &target->textures[i]);
+        glBindTexture(type, target->textures[i]);
+        if (scene->face_layers) {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB, target->width, target->height, CUBE_FACES, 0, GL_RGB,
+                         GL_UNSIGNED_BYTE, NULL);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, target->width, target->height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+        }
+        glGenerateMipmap(type); // Allocates the levels, so the texture is complete before the first render
+
+        // Set texture parameters for filtering and wrapping
+        glTexParameteri(type, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(type, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(type, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(type, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(type, 0); // Unbind the texture
+
+        // Attach the texture and the depth buffer, every layer of them with face layers: the geometry
+        // stage picks the layer of each triangle
+        if (scene->face_layers) {
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target->textures[i], 0);
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, target->depth_texture, 0);
+        } else {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->textures[i], 0);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target->depth_buffer);
+        }
+
+        // Check if the framebuffer is complete and ready for rendering
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            fprintf(stderr, "Framebuffer is not complete!\n");
+        }
+        target->rendered[i] = TARGET_NEVER;
+        target->mips_stale[i] = false;
+        GLint whole[4] = {0, 0, target->width, target->height}; // Undefined until cleared
+        memcpy(target->drawn[i], whole, sizeof(whole));
+    }
+
+    // GL calls outside the tracker, the next apply binds everything again
+    glh_state_reset(&scene->state);
+}
+
+// Render the armadillo to a target from now on, creating it the first time. The passes point at
+// its first buffer until select_target_buffers runs, and the cached render is dropped since the
+// new target holds none. A target used before still has renders of an older pose in its buffers:
+// they are marked never rendered so none is sampled, but their drawn boxes are kept since the
+// next render into each buffer has to clear them
+void use_offscreen_target(SceneData* scene, int32_t index) {
+    if (!scene->targets[index].width) {
+        init_offscreen_target(scene, index);
+    }
+    OffscreenTarget* target = &scene->targets[index];
+    for (int32_t i = 0; i < TARGET_MAX_BUFFERS; ++i) {
+        target->rendered[i] = TARGET_NEVER;
+    }
+    scene->target = index;
+    scene->write_buffer = 0;
+    scene->read_buffer = 0;
+    scene->model_pass.framebuffer = target->framebuffers[0];
+    scene->model_pass.viewport[2] = target->width; // The offscreen texture's own size
+    scene->model_pass.viewport[3] = target->height;
+    if (!scene->atlas_layers) {
+        scene->cube_pass.textures[0] = target->textures[0];
+    }
+    scene->cache_valid = false;
+}
+
+// Smallest box holding both boxes, x, y, width, height. An empty box adds nothing
+void join_boxes(const GLint a[4], const GLint b[4], GLint out[4]) {
+    if (a[2] <= 0 || a[3] <= 0 || b[2] <= 0 || b[3] <= 0) {
+        memcpy(out, a[2] > 0 && a[3] > 0 ? a : b, 4 * sizeof(GLint));
+        return;
+    }
+    GLint right = a[0] + a[2] > b[0] + b[2] ? a[0] + a[2] : b[0] + b[2];
+    GLint top = a[1] + a[3] > b[1] + b[3] ? a[1] + a[3] : b[1] + b[3];
+    out[0] = a[0] < b[0] ? a[0] : b[0];
+    out[1] = a[1] < b[1] ? a[1] : b[1];
+    out[2] = right - out[0];
+    out[3] = top - out[1];
+}
+
+// Restrict the model pass to the armadillo's box joined with the box the buffer's last render drew
+// into, which has to be cleared back to the background too. Outside both the buffer still holds the
+// background, so the cubes sample the same texture as without the scissor
+void scissor_model_pass(SceneData* scene, GLint drawn[4]) {
+    const OffscreenTarget* target = &scene->targets[scene->target];
+    GLint whole[4] = {0, 0, target->width, target->height};
+    GLint box[4];
+    if (scene->model_scissor) {
+        join_boxes(scene->model_box, drawn, box);
+        memcpy(drawn, scene->model_box, sizeof(box));
+    } else {
+        memcpy(box, whole, sizeof(box));
+        memcpy(drawn, whole, sizeof(box));
+    }
+    scene->model_pass.scissor = scene->model_scissor;
+    memcpy(scene->model_pass.scissor_box, box, sizeof(box));
+    scene->scissor_area += (double)box[2] * box[3] / ((double)target->width * target->height);
+}
+
+// Pick this frame's buffers. A render goes to the buffer rendered longest ago. The cubes sample the
+// newest buffer at least target_latency frames old, or the oldest one when none is that old yet,
+// e.g. in the first frames or right after a switch to another target (use_offscreen_target marks
+// every buffer of it never rendered). GL orders the render of a buffer after every earlier command
+// sampling it, so no buffer needs a fence of its own, they only have to differ
+void select_target_buffers(SceneData* scene) {
+    OffscreenTarget* target = &scene->targets[scene->target];
+    int32_t buffers = scene->target_latency + 1;
+    if (scene->model_stale) {
+        int32_t oldest = 0;
+        for (int32_t i = 1; i < buffers; ++i) {
+            oldest = target->rendered[i] < target->rendered[oldest] ? i : oldest;
+        }
+        scene->write_buffer = oldest;
+        target->rendered[oldest] = scene->frame_index;
+        scene->model_pass.framebuffer = target->framebuffers[oldest];
+        scissor_model_pass(scene, target->drawn[oldest]);
+    }
+
+    int32_t oldest = -1, ready = -1;
+    for (int32_t i = 0; i < buffers; ++i) {
+        if (target->rendered[i] == TARGET_NEVER) {
+            continue;
+        }
+        if (oldest < 0 || target->rendered[i] < target->rendered[oldest]) {
+            oldest = i;
+        }
+        if (target->rendered[i] <= (int64_t)scene->frame_index - scene->target_latency &&
+            (ready < 0 || target->rendered[i] > target->rendered[ready])) {
+            ready = i;
+        }
+    }
+    scene->read_buffer = ready >= 0 ? ready : oldest >= 0 ? oldest : 0;
+    scene->cube_pass.textures[0] = target->textures[scene->read_buffer];
+}
 
-    // Attach the texture to the FBO as the color attachment
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, scene->texture, 0);
+// Smallest size class with at least this many texels per side
+int32_t target_class(const SceneData* scene, float texels) {
+    int32_t index = 0;
+    while (index + 1 < scene->target_classes && (float)(TARGET_MIN_SIZE << index) < texels) {
+        ++index;
+    }
+    return index;
+}
+
+// Texels per side the cubes need at most: their bounding sphere on screen, which no rotation can
+// exceed. Every cube of the grid is as big and no closer than one at the origin
+float cube_bound_texels(const SceneData* scene) {
+    int32_t side = (int32_t)ceilf(sqrtf((float)scene->config.cubes));
+    float radius = 0.8660254f / (float)side; // Half the diagonal of the unit cube, scaled by the grid
+    float distance = vec3_norm(scene->frame_data.view_pos) - radius;
+    if (distance <= 0.0f) {
+        return INFINITY;
+    }
+    const float* projection = scene->frame_data.projection.data;
+    return fmaxf(radius * projection[0] / distance * (float)scene->config.width,
+                 radius * projection[5] / distance * (float)scene->config.height);
+}
+
+// Pixels across a cube on screen, the larger side of the box around its projected corners. A face
+// is never wider, so one texel per pixel is all the texture needs
+float cube_screen_texels(const SceneData* scene, mat4_t mvp) {
+    float low[2] = {INFINITY, INFINITY}, high[2] = {-INFINITY, -INFINITY};
+    for (int32_t corner = 0; corner < 8; ++corner) {
+        float x = corner & 1 ? 0.5f : -0.5f, y = corner & 2 ? 0.5f : -0.5f, z = corner & 4 ? 0.5f : -0.5f;
+        float clip[4];
+        for (int32_t row = 0; row < 4; ++row) {
+            clip[row] = mvp.data[row] * x + mvp.data[4 + row] * y + mvp.data[8 + row] * z + mvp.data[12 + row];
+        }
+        if (clip[3] <= 0.0f) {
+            return INFINITY; // Behind the camera, take the largest target
+        }
+        for (int32_t axis = 0; axis < 2; ++axis) {
+            low[axis] = fminf(low[axis], clip[axis] / clip[3]);
+            high[axis] = fmaxf(high[axis], clip[axis] / clip[3]);
+        }
+    }
+    return fmaxf((high[0] - low[0]) * 0.5f * (float)scene->config.width,
+                 (high[1] - low[1]) * 0.5f * (float)scene->config.height);
+}
+
+// Box of texels the armadillo can cover on the target: the box around its projected bounding box
+// corners, widened to whole texels and clamped to the target. The whole target if it reaches
+// behind the camera
+void model_target_box(const SceneData* scene, mat4_t mvp, GLint box[4]) {
+    const OffscreenTarget* target = &scene->targets[scene->target];
+    float low[2] = {INFINITY, INFINITY}, high[2] = {-INFINITY, -INFINITY};
+    for (int32_t corner = 0; corner < 8; ++corner) {
+        float x = corner & 1 ? scene->model_max.x : scene->model_min.x;
+        float y = corner & 2 ? scene->model_max.y : scene->model_min.y;
+        float z = corner & 4 ? scene->model_max.z : scene->model_min.z;
+        float clip[4];
+        for (int32_t row = 0; row < 4; ++row) {
+            clip[row] = mvp.data[row] * x + mvp.data[4 + row] * y + mvp.data[8 + row] * z + mvp.data[12 + row];
+        }
+        if (clip[3] <= 0.0f) {
+            low[0] = low[1] = -1.0f;
+            high[0] = high[1] = 1.0f;
+            break;
+        }
+        for (int32_t axis = 0; axis < 2; ++axis) {
+            low[axis] = fminf(low[axis], clip[axis] / clip[3]);
+            high[axis] = fmaxf(high[axis], clip[axis] / clip[3]);
+        }
+    }
+    int32_t size[2] = {target->width, target->height};
+    for (int32_t axis = 0; axis < 2; ++axis) {
+        float from = floorf((fmaxf(low[axis], -1.0f) * 0.5f + 0.5f) * (float)size[axis]);
+        float to = ceilf((fminf(high[axis], 1.0f) * 0.5f + 0.5f) * (float)size[axis]);
+        box[axis] = (GLint)from;
+        box[2 + axis] = to > from ? (GLint)(to - from) : 0; // Empty when it is off the target
+    }
+}
+
+// Pick the offscreen target for this frame's cubes. A bigger one is switched to at once, a smaller
+// one only after it did for TARGET_SHRINK_FRAMES frames in a row, so a size on the edge of two
+// classes does not switch back and forth
+void select_offscreen_target(SceneData* scene, float texels) {
+    if (scene->config.texture_width || scene->atlas_layers) {
+        return; // Fixed size, or nothing is rendered per frame
+    }
+    int32_t wanted = target_class(scene, texels);
+    if (wanted >= scene->target) {
+        scene->shrink_frames = 0;
+        if (wanted > scene->target) {
+            use_offscreen_target(scene, wanted);
+            scene->target_switches++;
+        }
+        return;
+    }
+    scene->shrink_class = scene->shrink_frames && scene->shrink_class > wanted ? scene->shrink_class : wanted;
+    if (++scene->shrink_frames >= TARGET_SHRINK_FRAMES) {
+        use_offscreen_target(scene, scene->shrink_class);
+        scene->target_switches++;
+        scene->shrink_frames = 0;
+    }
+}
 
-    // Clear the framebuffer's color and depth buffers
+// Pick the atlas layers of this frame's angle. Layer i holds the armadillo turned by i / layers of
+// a full turn, the last one blends back into the first
+void update_atlas_lookup(SceneData* scene) {
+    float turns = scene->frame_data.time * MODEL_SPEED / (2.0f * (float)PI);
+    float position = (turns - floorf(turns)) * (float)scene->atlas_layers;
+    if (!scene->atlas_blend) {
+        position = floorf(position + 0.5f); // Nearest angle only
+    }
+    int32_t layer = (int32_t)position;
+    scene->atlas_lookup[0] = (float)(layer % scene->atlas_layers);
+    scene->atlas_lookup[1] = (float)((layer + 1) % scene->atlas_layers);
+    scene->atlas_lookup[2] = position - (float)layer;
+}
+
+// Per-draw constant preparation - called once per draw on the CPU. Everything the vertex shaders
+// used to derive per vertex is computed here once: the model-view and model-view-projection
+// matrices, the normal matrix (one 3x3 inverse instead of a 4x4 inverse per vertex) and the
+// light in view space. `zoom` is the w of the world position, 1 for no zoom
+void prepare_draw_data(const FrameData* frame, mat4_t model, float zoom, vec3_t light_pos, DrawData* draw) {
+    mat4_t scale = mat4_identity();
+    scale.data[15] = zoom; // Clip space only, lighting sees the unzoomed positions
+    draw->model_view = mat4_mul(frame->view, model);
+    draw->mvp = mat4_mul(mat4_mul(frame->projection, frame->view), mat4_mul(scale, model));
+
+    // std140 stores each mat3 column in a vec4, the fourth components are never read
+    mat3_t normal = mat3_transpose(mat3_inverse(mat4_to_mat3(draw->model_view)));
+    for (int32_t i = 0; i < 3; ++i) {
+        draw->normal_matrix[i] = vec4(normal.col[i].x, normal.col[i].y, normal.col[i].z, 0.0f);
+    }
+    draw->light_pos = mat4_vec3_mul(frame->view, light_pos, 1);
+}
+
+void set_texture(DrawData* draw) {
+    // Define material properties, the light is part of FrameData
+    draw->object_color = vec3(0.6f, 1.0f, 0.3f);  // Color of the object/material
+    draw->roughness = 0.5f;  // Roughness factor for the material (used in PBR)
+    draw->metalness = 0.5f;  // Metalness factor for the material (used in PBR)
+}
+
+// Block of an offscreen armadillo render, matrices and material. With face layers the vertex stage
+// only moves it to world space, an identity view, and the geometry stage applies each face's camera
+void prepare_model_draw(const SceneData* scene, mat4_t model, DrawData* draw) {
+    FrameData frame = scene->frame_data;
+    if (scene->face_layers) {
+        frame.view = mat4_identity();
+    }
+    prepare_draw_data(&frame, model, MODEL_ZOOM, scene->frame_data.light_pos, draw);
+    set_texture(draw);
+}
+
+// Update draw data - called once per frame, writes the blocks of every draw through a single mapping
+void update_draw_data(SceneData* scene) {
+    // Waits only if the GPU is still FRAMES_IN_FLIGHT frames behind
+    glh_uniform_ring_begin_frame(&scene->draw_ring);
+
+    // The cube rotates around a diagonal axis at 0.15 radians per second, it has no material and
+    // a light of its own at (1, 1, 1). More cubes share the rotation, shrunk into a grid that
+    // covers the same area as the single one. Their size on screen sizes the offscreen target
+    DrawData draw = {0};
+    float texels = 0.0f;
+    int32_t side = (int32_t)ceilf(sqrtf((float)scene->config.cubes));
+    float scale = 1.0f / (float)side;
+    mat4_t rotation = mat4_make_rotation(vec3(0.7071068f, 0.7071068f, 0.0f), scene->frame_data.time * 0.15f);
+    for (int32_t i = 0; i < scene->config.cubes; ++i) {
+        mat4_t placement = mat4_diag(scale);
+        placement.data[12] = ((float)(i % side) + 0.5f) * scale * 2.0f - 1.0f;
+        placement.data[13] = ((float)(i / side) + 0.5f) * scale * 2.0f - 1.0f;
+        placement.data[15] = 1.0f; // A single cube keeps the identity, as in the regular scene
+        memset(&draw, 0, sizeof(draw));
+        prepare_draw_data(&scene->frame_data, mat4_mul(placement, rotation), 1.0f, vec3(1.0f, 1.0f, 1.0f), &draw);
+        scene->cube_offsets[i] = push_draw_data(scene, &draw);
+        texels = fmaxf(texels, cube_screen_texels(scene, draw.mvp));
+    }
+    scene->draw_offsets[DRAW_CUBE] = scene->cube_offsets[0];
+    scene->draw_pipelines[DRAW_CUBE] = glh_pipeline(&scene->pipelines, scene->cube_vertex, 0, scene->cube_fragment);
+    select_offscreen_target(scene, texels);
+
+    // The armadillo rotates around the X-axis at 0.5 radians per second, lit by the frame's light.
+    // Its block is only written on frames that re-render the cached texture, never with the atlas
+    memset(&draw, 0, sizeof(draw));
+    mat4_t model = mat4_make_rotation(vec3(1.0f, 0.0f, 0.0f), scene->frame_data.time * MODEL_SPEED);
+    scene->model_stale = !scene->atlas_layers && model_cache_stale(scene, model);
+    if (scene->atlas_layers) {
+        update_atlas_lookup(scene);
+    } else if (scene->model_stale && glh_visibility_hidden(&scene->cube_visibility)) {
+        // No cube sample passed the last time it was known, nothing would show the render. The cache
+        // is dropped so the first frame the cubes are visible again re-renders it
+        scene->model_stale = false;
+        scene->cache_valid = false;
+        scene->model_hidden++;
+    } else if (scene->model_stale) {
+        prepare_model_draw(scene, model, &draw);
+        if (scene->model_scissor) { // Off with face layers, draw.mvp is not any face's camera
+            model_target_box(scene, draw.mvp, scene->model_box); // Scissors the render, select_target_buffers
+        }
+        scene->draw_offsets[DRAW_MODEL] = push_draw_data(scene, &draw);
+        scene->draw_pipelines[DRAW_MODEL] = material_pipeline(scene, &draw);
+        scene->cached_model = model;
+        scene->cached_time = scene->frame_data.time;
+        scene->cache_valid = true;
+        scene->model_renders++;
+    } else {
+        scene->model_skips++;
+    }
+    if (!scene->atlas_layers) {
+        select_target_buffers(scene); // The buffer this render goes to and the one the cubes sample
+    }
+}
+
+// Initialize render states - called once, after the programs, VAOs and the offscreen target exist
+void init_render_states(SceneData* scene) {
+    // Both passes cover their whole target with depth testing and no blending or culling
+    glh_render_state_t state = glh_default_render_state();
+    state.viewport[2] = scene->config.width;
+    state.viewport[3] = scene->config.height;
+    state.depth_test = true;
+
+    // Armadillo into the offscreen texture, on a dark gray background. The pipeline has the variant
+    // of its material, each draw still selects its own with glh_state_use_pipeline
+    const float model_clear[4] = {0.1f, 0.1f, 0.1f, 1.0f};
+    DrawData material = {0};
+    set_texture(&material);
+    scene->model_pass = state; // The framebuffer and viewport are the target's, use_offscreen_target
+    scene->model_pass.pipeline = material_pipeline(scene, &material);
+    scene->model_pass.vao = scene->model_vao;
+    memcpy(scene->model_pass.clear_color, model_clear, sizeof(model_clear));
+
+    // Textured cube on screen, on a dark blue background, sampling the offscreen texture on unit 0
+    const float cube_clear[4] = {0.3f, 0.3f, 0.45f, 1.0f};
+    scene->cube_pass = state;
+    scene->cube_pass.framebuffer = 0;
+    scene->cube_pass.pipeline = glh_pipeline(&scene->pipelines, scene->cube_vertex, 0, scene->cube_fragment);
+    scene->cube_pass.vao = scene->cube_vao;
+    scene->cube_pass.texture_targets[0] = scene->face_layers ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+    memcpy(scene->cube_pass.clear_color, cube_clear, sizeof(cube_clear));
+}
+
+void init_texture(SceneData* scene, MeshData* mesh) {
+    // The pass states come first, the target fills in the model pass' framebuffer and viewport and
+    // the texture the cube pass samples. The tracker knows nothing yet, the first apply sets every
+    // field: framebuffer, viewport, program, VAO...
+    init_render_states(scene);
+    if (scene->atlas_layers) {
+        return; // Nothing is rendered per frame, init_rotation_atlas renders every layer itself
+    }
+    use_offscreen_target(scene, scene->target);
+    glh_state_apply(&scene->state, &scene->model_pass);
+
+    // Clear the framebuffer (color and depth buffers)
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glClearColor(0.1f, 0.1f, 0.1f, 1.0f); // Set the clear color to a dark gray
 
-    // Define the camera position and orientation
-    vec3_t eye = vec3(0.0f, 0.0f, 3.0f);     // Camera position
-    vec3_t center = vec3(0.0f, 0.0f, 0.0f);  // Point the camera is looking at
-    vec3_t up = vec3(0.0f, 1.0f, 0.0f);      // Up direction for the camera
+    // The pose update_draw_data gives the first frame, the cubes may sample this render before the
+    // loop's own ones are old enough. This draw gets a ring frame of its own
+    DrawData draw = {0};
+    mat4_t model = mat4_make_rotation(vec3(1.0f, 0.0f, 0.0f), scene->frame_data.time * MODEL_SPEED);
+    prepare_model_draw(scene, model, &draw); // Matrices, light and material
+
+    glh_uniform_ring_begin_frame(&scene->draw_ring);
+    bind_draw_data(scene, push_draw_data(scene, &draw));
+    glh_state_use_pipeline(&scene->state, material_pipeline(scene, &draw)); // Variant of the material
+
+    // Render the model, the framebuffer and VAO stay bound for the tracker to reuse
+    GLCHECK(glDrawElements(GL_TRIANGLES, scene->model_indices, GL_UNSIGNED_INT, 0));
+    glh_uniform_ring_end_frame(&scene->draw_ring);
+    scene->targets[scene->target].rendered[0] = -1; // Before the first frame, so any latency can sample it
+    scene->targets[scene->target].mips_stale[0] = true;
+}
+
+// Pick the first offscreen target - called once after init_frame_data, before anything is rendered.
+// A fixed size has a single target, otherwise it is the class of the cubes' largest possible size
+void init_offscreen_targets(SceneData* scene) {
+    GLint max_size = 2048;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    scene->target_classes = 1;
+    while (scene->target_classes < TARGET_CLASSES && TARGET_MIN_SIZE << scene->target_classes <= max_size) {
+        scene->target_classes++;
+    }
+    scene->target = scene->config.texture_width ? 0 : target_class(scene, cube_bound_texels(scene));
+}
+
+// Delete every target that was created
+void free_offscreen_targets(SceneData* scene) {
+    for (int32_t i = 0; i < TARGET_CLASSES; ++i) {
+        glDeleteFramebuffers(TARGET_MAX_BUFFERS, scene->targets[i].framebuffers);
+        glDeleteTextures(TARGET_MAX_BUFFERS, scene->targets[i].textures);
+        glDeleteRenderbuffers(1, &scene->targets[i].depth_buffer);
+        glDeleteTextures(1, &scene->targets[i].depth_texture);
+    }
+}
+
+// Number of atlas layers that fit the memory budget and the driver's limits, 0 disables the atlas
+// The layers have the size of the first offscreen target, init_offscreen_targets picks it
+int32_t fit_atlas_layers(const SceneData* scene, int32_t layers, float budget_mb) {
+    if (layers <= 0) {
+        return 0;
+    }
+    GLint max_layers = 256; // The minimum GL 4.1 guarantees
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+    int32_t width, height;
+    offscreen_target_size(scene, scene->target, &width, &height);
+    double layer_bytes = 4.0 * width * height * 4.0 / 3.0; // RGBA8 with its mip levels
+    int32_t fit = (int32_t)(budget_mb * 1024.0 * 1024.0 / layer_bytes);
+    fit = fit < max_layers ? fit : max_layers;
+    fit = fit < MAX_DRAWS_PER_FRAME ? fit : MAX_DRAWS_PER_FRAME; // One ring frame renders them all
+    if (fit < layers) {
+        printf("Rotation atlas: %d layers of %dx%d do not fit %.0f MB, using %d\n",
+               layers, width, height, budget_mb, fit);
+        layers = fit;
+    }
+    return layers;
+}
+
+// Initialize the rotation atlas - called once after init_texture, renders every layer with the
+// model pass and points the cube pass at the array. Prints its startup cost and memory
+void init_rotation_atlas(SceneData* scene) {
+    double start = glfwGetTime();
+    int32_t width, height;
+    offscreen_target_size(scene, scene->target, &width, &height);
+    glGenTextures(1, &scene->atlas_texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, scene->atlas_texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, scene->atlas_layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    // No offscreen target exists in atlas mode, the layers are rendered through a framebuffer and
+    // depth buffer of their own that only live until the atlas is done
+    GLuint framebuffer, depth_buffer;
+    glGenRenderbuffers(1, &depth_buffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
+    glGenFramebuffers(1, &framebuffer);
+    scene->model_pass.framebuffer = framebuffer;
+    scene->model_pass.viewport[2] = width;
+    scene->model_pass.viewport[3] = height;
+
+    // Every layer is one model pass into the framebuffer with that layer attached, the depth buffer
+    // is shared. All the blocks fit one ring frame, fit_atlas_layers made sure of it
+    glh_state_apply(&scene->state, &scene->model_pass);
+    GLCHECK(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_buffer));
+    glh_uniform_ring_begin_frame(&scene->draw_ring);
+    for (int32_t i = 0; i < scene->atlas_layers; ++i) {
+        GLCHECK(glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, scene->atlas_texture, 0, i));
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        DrawData draw = {0};
+        float angle = 2.0f * (float)PI * (float)i / (float)scene->atlas_layers;
+        prepare_draw_data(&scene->frame_data, mat4_make_rotation(vec3(1.0f, 0.0f, 0.0f), angle), MODEL_ZOOM,
+                          scene->frame_data.light_pos, &draw);
+        set_texture(&draw);
+        bind_draw_data(scene, push_draw_data(scene, &draw));
+        glh_state_use_pipeline(&scene->state, material_pipeline(scene, &draw));
+        GLCHECK(glDrawElements(GL_TRIANGLES, scene->model_indices, GL_UNSIGNED_INT, 0));
+    }
+    glh_uniform_ring_end_frame(&scene->draw_ring);
+
+    // The cubes sample the array from now on, the model pass never runs again. Its mip levels are
+    // generated once here, through the tracker so it knows what unit 0 has. The apply binds the
+    // screen, so the layers' framebuffer is no longer the tracker's and can go
+    scene->cube_pass.texture_targets[0] = GL_TEXTURE_2D_ARRAY;
+    scene->cube_pass.textures[0] = scene->atlas_texture;
+    glh_state_apply(&scene->state, &scene->cube_pass);
+    GLCHECK(glGenerateMipmap(GL_TEXTURE_2D_ARRAY));
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &depth_buffer);
+    scene->model_pass.framebuffer = 0;
+
+    // Wait for the GPU, so the startup cost includes the renders and not just their submission
+    glFinish();
+    scene->atlas_ms = (glfwGetTime() - start) * 1000.0;
+    scene->atlas_mb = 4.0 * width * height * scene->atlas_layers * 4.0 / 3.0 / (1024.0 * 1024.0);
+    printf("Rotation atlas: %d layers of %dx%d, %.1f MB with mip levels, rendered in %.1f ms\n",
+           scene->atlas_layers, width, height, scene->atlas_mb, scene->atlas_ms);
+}
 
-    // Use the shader program for rendering
-    glUseProgram(scene->model_program);
+// Frame function - called on every frame, performs the rendering
+void frame(SceneData* scene, MeshData* mesh_data) {
+    // Switch to the screen, the cube pipeline and VAO, the offscreen texture and the dark blue
+    // background. The viewport, depth and blend state match the model pass and cost nothing
+    glh_gpu_begin(&scene->gpu_timer, scene->cube_timer); // Time the pass on the GPU, clear included
+    glh_state_apply(&scene->state, &scene->cube_pass);
 
-    // Calculate the rotation angle based on elapsed time for animation
-    float angle = (float)glfwGetTime() * 0.5f; // Rotate at 0.5 radians per second
-    vec3_t axis = vec3(1.0f, 0.0f, 0.0f);     // Rotation around the X-axis
+    // Clear the screen, the camera comes from FrameData
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // Create the transformation matrices
-    mat4_t model = mat4_make_rotation(axis, angle); // Model matrix with rotation
-    mat4_t view = look_at(eye, center, up);         // View matrix for camera
-    mat4_t projection = perspective(deg2rad(45.0f), (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT, 0.1f, 100.0f); // Perspective projection matrix
+    // A fresh render of the armadillo needs its mip levels. The pass just bound it on unit 0, the
+    // only unit in use and so the active one, which keeps the tracker right
+    OffscreenTarget* target = &scene->targets[scene->target];
+    if (!scene->atlas_layers && target->mips_stale[scene->read_buffer]) {
+        GLCHECK(glGenerateMipmap(scene->cube_pass.texture_targets[0]));
+        target->mips_stale[scene->read_buffer] = false;
+    }
 
-    // Retrieve the locations of the uniform variables in the shader
-    GLuint model_loc = glGetUniformLocation(scene->model_program, "model");
-    GLuint view_loc = glGetUniformLocation(scene->model_program, "view");
-    GLuint proj_loc = glGetUniformLocation(scene->model_program, "projection");
+    glh_state_use_pipeline(&scene->state, scene->draw_pipelines[DRAW_CUBE]);
+    glh_set_uniform_1i(scene->basic_info, scene->basic_uniforms.texture, 0); // Set texture unit 0, skipped once set
+    glh_set_uniform_3fv(scene->basic_info, scene->basic_uniforms.atlas_lookup, scene->atlas_lookup); // No-op without the atlas
+
+    // Render every cube, the VAO and texture stay bound for the tracker to reuse. The model matrices
+    // were written in update_draw_data, only their ranges are bound here. The draws are their own
+    // occlusion query, a later frame skips the armadillo when none of them drew a sample
+    glh_visibility_begin(&scene->cube_visibility);
+    for (int32_t i = 0; i < scene->config.cubes; ++i) {
+        bind_draw_data(scene, scene->cube_offsets[i]);
+        GLCHECK(glDrawArrays(GL_TRIANGLES, 0, 36)); // Draw the cube (assuming 36 vertices for a cube)
+    }
+    glh_visibility_end(&scene->cube_visibility);
+    glh_gpu_end(&scene->gpu_timer, scene->cube_timer);
+}
 
-    // Set the transformation matrices in the shader
-    glUniformMatrix4fv(model_loc, 1, GL_FALSE, (const GLfloat*)&model);
-    glUniformMatrix4fv(view_loc, 1, GL_FALSE, (const GLfloat*)&view);
-    glUniformMatrix4fv(proj_loc, 1, GL_FALSE, (const GLfloat*)&projection);
+void render_model(SceneData* scene, MeshData* mesh) {
+    // Switch to the offscreen framebuffer, the model pipeline and VAO and the dark gray background.
+    // The texture stays attached since init_texture, attachments are part of the framebuffer object
+    glh_gpu_begin(&scene->gpu_timer, scene->model_timer); // Time the pass on the GPU, clear included
+    glh_state_apply(&scene->state, &scene->model_pass);
 
-    // Bind and set up the texture
-    set_texture(scene);
+    // Clear the framebuffer's color and depth buffers, the camera comes from FrameData
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // Bind the vertex array object (VAO) for the model
-    glBindVertexArray(scene->model_vao);
+    // The model matrix and material were written in update_draw_data, only their range is bound here.
+    // The variant was selected there too, from the material
+    bind_draw_data(scene, scene->draw_offsets[DRAW_MODEL]);
+    glh_state_use_pipeline(&scene->state, scene->draw_pipelines[DRAW_MODEL]);
 
-    // Draw the model using the element buffer
-    glDrawElements(GL_TRIANGLES, mesh->triangle_count * 3, GL_UNSIGNED_INT, 0);
+    // Draw the model using the element buffer, the VAO and framebuffer stay bound. With face layers
+    // this one draw fills every face, the geometry stage runs once per face
+    GLCHECK(glDrawElements(GL_TRIANGLES, scene->model_indices, GL_UNSIGNED_INT, 0));
+    glh_gpu_end(&scene->gpu_timer, scene->model_timer);
+    scene->targets[scene->target].mips_stale[scene->write_buffer] = true; // Generated once the cubes sample it
+}
 
-    // Unbind the VAO
-    glBindVertexArray(0);
+// Print the rolling GPU time of every timed pass, over the last GLH_GPU_TIMER_HISTORY frames
+void print_gpu_times(const SceneData* scene) {
+    for (int32_t i = 0; i < scene->gpu_timer.pass_count; ++i) {
+        glh_gpu_stats_t stats;
+        if (glh_gpu_stats(&scene->gpu_timer, i, &stats)) {
+            continue; // No result came back yet, or the context has no timer
+        }
+        printf("GPU %-12s min %.3f ms | avg %.3f ms | p99 %.3f ms (%u frames)\n",
+               scene->gpu_timer.passes[i].name, stats.min, stats.avg, stats.p99, stats.count);
+    }
+    if (scene->gpu_timer.dropped) {
+        printf("GPU timer results dropped: %u\n", scene->gpu_timer.dropped);
+    }
+}
 
-    // Unbind the framebuffer object to render to the default framebuffer (the screen)
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+// Print how often the offscreen armadillo was re-rendered over the whole run
+void print_cache_stats(const SceneData* scene) {
+    uint32_t frames = scene->model_renders + scene->model_skips + scene->model_hidden;
+    if (frames) {
+        printf("Offscreen armadillo: %u of %u frames re-rendered, %.1f%% skipped\n",
+               scene->model_renders, frames, 100.0 * (scene->model_skips + scene->model_hidden) / frames);
+    }
+    if (scene->model_hidden) {
+        printf("Offscreen armadillo: %u frames skipped with no cube visible\n", scene->model_hidden);
+    }
+    if (scene->cube_visibility.dropped) {
+        printf("Visibility results dropped: %u\n", scene->cube_visibility.dropped);
+    }
+    if (scene->model_renders) {
+        printf("Offscreen armadillo: %.1f%% of the target cleared and drawn per render\n",
+               100.0 * scene->scissor_area / scene->model_renders);
+    }
 }
 
-int32_t main(int32_t argc, char** argv) {
-    // Initialize GLFW
-    if (!glfwInit()) {
-        // If GLFW fails to initialize, print an error message and terminate the application
-        printf("Failed to initialize GLFW! Terminating\n");
-        exit(EXIT_FAILURE);
+// Copy the GPU frame times that came back since the last call, at most GLH_GPU_TIMER_FRAMES per
+// frame so the timer's history never wraps past one that was not read. Times of warmup frames are
+// skipped by the frame they were measured in, dropped query sets leave gaps in the samples
+void collect_gpu_frames(const SceneData* scene, int32_t warmup, uint32_t* read, double* ms, int32_t* count) {
+    const glh_gpu_pass_t* pass = &scene->gpu_timer.passes[scene->frame_timer];
+    for (; *read < pass->samples; ++*read) {
+        if (pass->history_frame[*read % GLH_GPU_TIMER_HISTORY] >= warmup) {
+            ms[(*count)++] = pass->history[*read % GLH_GPU_TIMER_HISTORY];
+        }
+    }
+}
+
+// Command line options
+typedef struct RunOptions {
+    bool headless;         // Invisible window, fixed timestep, frame time report
+    bool suite;            // Headless run of every scenario in suite_configs
+    int32_t frames;        // Frames to render, 0 runs until the window is closed, -1 until parsed
+    int32_t warmup;        // Leading frames left out of the report, -1 until parsed
+    double timestep;       // Seconds per frame, 0 follows the wall clock, -1 until parsed
+    SceneConfig config;    // Scene of a single run, the default one unless scaled
+    CachePolicy cache_policy;  // When the offscreen armadillo is re-rendered
+    int32_t latency;           // Frames the cubes' texture may lag behind the armadillo's render
+    bool no_scissor;           // Clear and draw the whole offscreen target
+    bool no_occlusion;         // Render the armadillo even when no cube is visible
+    bool faces;                // Every cube face shows the armadillo from its own side
+    int32_t atlas_layers;      // Angles of the rotation atlas, 0 renders the armadillo every frame
+    float atlas_budget;        // Megabytes the atlas may take, fewer layers are used beyond that
+    bool atlas_blend;          // Blend the two nearest angles of the atlas
+    const char* json_path; // Frame time report, NULL prints it to stdout
+    const char* csv_path;      // Suite results as CSV, one row per scenario and timer
+    const char* filter;        // Substring of the suite's result names to run
+    const char* baseline_path; // Suite results to compare against, regressions fail the run
+    double threshold;          // Percent slower than the baseline that counts as a regression
+} RunOptions;
+
+// Scenarios of --suite, each scales one dimension of the default scene: cubes on screen,
+// armadillo triangles, offscreen texture resolution and window resolution
+const SceneConfig suite_configs[] = {
+    {"default",          800,  600,    0,    0,    1, 1.0f},
+    {"cubes_16",         800,  600,    0,    0,   16, 1.0f},
+    {"cubes_256",        800,  600,    0,    0,  256, 1.0f},
+    {"cubes_1024",       800,  600,    0,    0, 1024, 1.0f},
+    {"triangles_12",     800,  600,    0,    0,    1, 0.125f},
+    {"triangles_25",     800,  600,    0,    0,    1, 0.25f},
+    {"triangles_50",     800,  600,    0,    0,    1, 0.5f},
+    {"texture_256",      800,  600,  256,  256,    1, 1.0f},
+    {"texture_1024",     800,  600, 1024, 1024,    1, 1.0f},
+    {"texture_2048",     800,  600, 2048, 2048,    1, 1.0f},
+    {"window_320x240",   320,  240,    0,    0,    1, 1.0f},
+    {"window_1280x720", 1280,  720,    0,    0,    1, 1.0f},
+    {"window_1920x1080", 1920, 1080,   0,    0,    1, 1.0f},
+};
+#define SUITE_SCENARIOS (int32_t)(sizeof(suite_configs) / sizeof(suite_configs[0]))
+
+// Parse the command line, returns 1 on unknown or incomplete arguments
+int8_t parse_options(int32_t argc, char** argv, RunOptions* options) {
+    memset(options, 0, sizeof(*options));
+    options->config = default_config;
+    options->threshold = SUITE_THRESHOLD;
+    options->cache_policy = default_cache_policy;
+    options->atlas_budget = ATLAS_BUDGET_MB;
+    options->latency = TARGET_LATENCY;
+    options->frames = -1; // Not given, the defaults depend on --headless
+    options->warmup = -1;
+    options->timestep = -1.0;
+    SceneConfig* config = &options->config;
+    for (int32_t i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (!strcmp(arg, "--headless")) {
+            options->headless = true;
+        } else if (!strcmp(arg, "--suite")) {
+            options->suite = true;
+            options->headless = true; // Every scenario is a fixed-length headless run
+        } else if (!strcmp(arg, "--cubes") && has_value) {
+            config->cubes = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--triangles") && has_value) {
+            config->triangles = (float)atof(argv[++i]);
+        } else if (!strcmp(arg, "--texture") && has_value) {
+            if (sscanf(argv[++i], "%dx%d", &config->texture_width, &config->texture_height) != 2) {
+                return 1;
+            }
+        } else if (!strcmp(arg, "--window") && has_value) {
+            if (sscanf(argv[++i], "%dx%d", &config->width, &config->height) != 2) {
+                return 1;
+            }
+        } else if (!strcmp(arg, "--cache-angle") && has_value) {
+            options->cache_policy.max_angle = deg2rad((float)atof(argv[++i]));
+        } else if (!strcmp(arg, "--cache-texels") && has_value) {
+            options->cache_policy.max_texels = (float)atof(argv[++i]);
+        } else if (!strcmp(arg, "--cache-rate") && has_value) {
+            options->cache_policy.max_rate = (float)atof(argv[++i]);
+        } else if (!strcmp(arg, "--no-cache")) {
+            memset(&options->cache_policy, 0, sizeof(options->cache_policy)); // Re-render every frame
+        } else if (!strcmp(arg, "--no-scissor")) {
+            options->no_scissor = true;
+        } else if (!strcmp(arg, "--no-occlusion")) {
+            options->no_occlusion = true;
+        } else if (!strcmp(arg, "--faces")) {
+            options->faces = true;
+        } else if (!strcmp(arg, "--latency") && has_value) {
+            options->latency = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--atlas") && has_value) {
+            options->atlas_layers = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--atlas-budget") && has_value) {
+            options->atlas_budget = (float)atof(argv[++i]);
+        } else if (!strcmp(arg, "--atlas-blend")) {
+            options->atlas_blend = true;
+        } else if (!strcmp(arg, "--csv") && has_value) {
+            options->csv_path = argv[++i];
+        } else if (!strcmp(arg, "--filter") && has_value) {
+            options->filter = argv[++i];
+        } else if (!strcmp(arg, "--baseline") && has_value) {
+            options->baseline_path = argv[++i];
+        } else if (!strcmp(arg, "--threshold") && has_value) {
+            options->threshold = atof(argv[++i]);
+        } else if (!strcmp(arg, "--frames") && has_value) {
+            options->frames = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--warmup") && has_value) {
+            options->warmup = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--timestep") && has_value) {
+            options->timestep = atof(argv[++i]);
+        } else if (!strcmp(arg, "--json") && has_value) {
+            options->json_path = argv[++i];
+        } else {
+            return 1;
+        }
+    }
+
+    // Headless runs are benchmarks: a fixed number of frames at a fixed timestep, unless overridden.
+    // Only values that were not given get a default, so --warmup 0 or --timestep 0 stay 0
+    bool unset_frames = options->frames == -1, unset_warmup = options->warmup == -1;
+    bool unset_timestep = options->timestep == -1.0;
+    options->frames = unset_frames ? (options->headless ? HEADLESS_FRAMES : 0) : options->frames;
+    options->warmup = unset_warmup ? (options->headless ? HEADLESS_WARMUP : 0) : options->warmup;
+    options->timestep = unset_timestep ? (options->headless ? FIXED_TIMESTEP : 0.0) : options->timestep;
+    if (options->frames < 0 || options->warmup < 0 || options->timestep < 0.0 ||
+        (options->headless && !options->frames)) { // No window to close in a headless run
+        return 1;
+    }
+    if (config->cubes < 1 || config->cubes > MAX_CUBES || config->triangles <= 0.0f || config->triangles > 1.0f ||
+        config->width <= 0 || config->height <= 0 || config->texture_width < 0 || config->texture_height < 0 ||
+        !config->texture_width != !config->texture_height) {
+        return 1;
+    }
+    const CachePolicy* policy = &options->cache_policy;
+    if (policy->max_angle < 0.0f || policy->max_texels < 0.0f || policy->max_rate < 0.0f ||
+        options->atlas_layers < 0 || options->atlas_budget <= 0.0f || (options->faces && options->atlas_layers) ||
+        options->latency < 0 || options->latency >= TARGET_MAX_BUFFERS) {
+        return 1;
+    }
+    if (options->warmup >= options->frames) {
+        options->warmup = 0; // Too short to spare any, report every frame
+    }
+    return 0;
+}
+
+// Write the distribution of frame times as a JSON object, sorts the samples in place
+void write_time_stats(FILE* file, const char* key, double* ms, int32_t count) {
+    fprintf(file, "  \"%s\": {\"samples\": %d", key, count);
+    if (count > 0) {
+        bench_result_t stats = {0}; // Same statistics as the suite, the unit carries through
+        bench_summarize(ms, count, &stats);
+        fprintf(file, ", \"min\": %.4f, \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f",
+                stats.min, stats.mean, stats.median, stats.p95, stats.p99, stats.max);
+    }
+    fprintf(file, "}");
+}
+
+// Write a string as a JSON string literal, escaping quotes, backslashes and control characters
+void write_json_string(FILE* file, const char* str) {
+    fputc('"', file);
+    for (const char* c = str ? str : ""; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(file, "\\%c", *c);
+        } else if ((unsigned char)*c < 0x20) {
+            fprintf(file, "\\u%04x", (unsigned char)*c);
+        } else {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+// Write the frame time report of a fixed-length run, in milliseconds
+int8_t write_frame_report(const RunOptions* options, const SceneData* scene,
+                          double* cpu_ms, int32_t cpu_count, double* gpu_ms, int32_t gpu_count) {
+    FILE* file = options->json_path ? fopen(options->json_path, "w") : stdout;
+    if (!file) {
+        fprintf(stderr, "[ERROR] Could not write %s!\n", options->json_path);
+        return 1;
+    }
+    // Driver strings are free text, e.g. quotes in a renderer name
+    fprintf(file, "{\n  \"renderer\": ");
+    write_json_string(file, (const char*)glGetString(GL_RENDERER));
+    fprintf(file, ",\n  \"version\": ");
+    write_json_string(file, (const char*)glGetString(GL_VERSION));
+    fprintf(file, ",\n");
+    int32_t texture_width, texture_height; // The atlas layers' size in atlas mode, there is no target
+    offscreen_target_size(scene, scene->target, &texture_width, &texture_height);
+    fprintf(file, "  \"width\": %d,\n  \"height\": %d,\n  \"texture_width\": %d,\n  \"texture_height\": %d,\n",
+            scene->config.width, scene->config.height, texture_width, texture_height);
+    fprintf(file, "  \"target_switches\": %u,\n  \"latency\": %d,\n", scene->target_switches, scene->target_latency);
+    fprintf(file, "  \"face_layers\": %d,\n", scene->face_layers ? CUBE_FACES : 0);
+    fprintf(file, "  \"cubes\": %d,\n  \"triangles\": %d,\n", scene->config.cubes, scene->model_indices / 3);
+    fprintf(file, "  \"frames\": %u,\n  \"warmup\": %d,\n  \"timestep\": %.6f,\n",
+            scene->frame_index, options->warmup, scene->timestep);
+    write_time_stats(file, "cpu_ms", cpu_ms, cpu_count);
+    fprintf(file, ",\n");
+    write_time_stats(file, "gpu_ms", gpu_ms, gpu_count);
+    fprintf(file, ",\n  \"gpu_dropped\": %u,\n", scene->gpu_timer.dropped);
+    fprintf(file, "  \"model_renders\": %u,\n  \"model_skips\": %u,\n  \"model_hidden\": %u,\n",
+            scene->model_renders, scene->model_skips, scene->model_hidden);
+    fprintf(file, "  \"scissor_coverage\": %.3f,\n",
+            scene->model_renders ? scene->scissor_area / scene->model_renders : 0.0);
+    fprintf(file, "  \"atlas_layers\": %d,\n  \"atlas_mb\": %.1f,\n  \"atlas_ms\": %.2f\n}\n", scene->atlas_layers,
+            scene->atlas_mb, scene->atlas_ms);
+    if (file != stdout) {
+        fclose(file);
     }
+    return 0;
+}
 
+// Add a scenario's frame times to the suite, in ns per frame like every other benchmark
+void add_scene_results(bench_suite_t* suite, const SceneConfig* config,
+                       double* cpu_ms, int32_t cpu_count, double* gpu_ms, int32_t gpu_count) {
+    char name[BENCH_NAME_LENGTH];
+    for (int32_t i = 0; i < cpu_count; ++i) {
+        cpu_ms[i] *= 1e6;
+    }
+    for (int32_t i = 0; i < gpu_count; ++i) {
+        gpu_ms[i] *= 1e6;
+    }
+    bench_set_context(suite, "gl_renderer", (const char*)glGetString(GL_RENDERER));
+    bench_set_context(suite, "gl_version", (const char*)glGetString(GL_VERSION));
+    snprintf(name, sizeof(name), "scene/%s/cpu_frame", config->name);
+    bench_add_samples(suite, name, cpu_ms, cpu_count, 0.0);
+    snprintf(name, sizeof(name), "scene/%s/gpu_frame", config->name);
+    bench_add_samples(suite, name, gpu_ms, gpu_count, 0.0);
+}
+
+// Run one scene from creating its window to destroying it. With a suite the frame times are added
+// to it, otherwise a fixed-length run writes its own report. Returns 1 on failure
+int8_t run_scene(const RunOptions* options, const SceneConfig* config, bench_suite_t* suite) {
+    PROF_BEGIN("startup");
     // Set GLFW window hints for OpenGL version and profile
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4); // Set the major version of OpenGL to 4
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1); // Set the minor version of OpenGL to 1
     glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);       // Make the window non-resizable
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE); // Use the core profile of OpenGL
     glfwWindowHint(GLFW_SAMPLES, 4);                // Enable 4x multisampling for anti-aliasing
+    glfwWindowHint(GLFW_VISIBLE, options->headless ? GLFW_FALSE : GLFW_TRUE); // Headless renders to an invisible window
+#if GLH_DEBUG
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE); // Drivers report every error through the debug callback
+#else
+    glfwWindowHint(GLFW_CONTEXT_NO_ERROR, GLFW_TRUE); // Nothing checks errors in release, let the driver skip them too
+#endif
 
     // Create a GLFW window
-    GLFWwindow* window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Yembo", NULL, NULL);
+    GLFWwindow* window = glfwCreateWindow(config->width, config->height, "Yembo", NULL, NULL);
     if (!window) {
-        // If window creation fails, terminate GLFW and the application
-        glfwTerminate();
+        // If window creation fails, print an error message and let the caller terminate GLFW
         printf("Failed to create window! Terminating!\n");
-        exit(EXIT_FAILURE);
+        PROF_END(); // startup
+        return 1;
     }
 
     // Make the OpenGL context current
     glfwMakeContextCurrent(window);
+    if (options->headless) {
+        glfwSwapInterval(0); // Measure the frames, not the display's refresh rate
+    }
 
     // Initialize GLAD to manage OpenGL function pointers
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
         // If GLAD fails to load OpenGL functions, print an error message and return
         fprintf(stderr, "[ERROR] Failed to initialize OpenGL context!\n");
+        glfwDestroyWindow(window);
+        PROF_END(); // startup
         return 1;
     }
 
-    // Enable depth testing to ensure proper rendering of 3D objects
-    glEnable(GL_DEPTH_TEST);
+    // Detect optional extensions (parallel shader compile, debug output in debug builds)
+    glh_init((GLADloadproc)glfwGetProcAddress);
+
+    // Submit the stage programs and the armadillo's fragment variant (or load them from the binary
+    // cache) before loading the mesh, so the driver compiles them while we read the file and upload
+    // the buffers. Every stage is a separable program, the pipelines pair them without linking
+    SceneData scene = {0}; // Initialize scene data structure
+    scene.config = *config;            // Resolutions and amount of geometry
+    scene.timestep = options->timestep; // Fixed animation step, 0 follows the wall clock
+    scene.cache_policy = options->cache_policy; // When the offscreen armadillo is re-rendered
+    scene.atlas_blend = options->atlas_blend;
+    scene.target_latency = options->latency; // Offscreen buffers the passes alternate between, minus one
+    scene.face_layers = options->faces; // A layer per cube face, rendered in one draw
+    scene.model_scissor = !options->no_scissor && !options->faces; // Only the armadillo's box is cleared, one view only
+    glh_program_job_t programs[3] = {
+        {cube_vrtx_shdr_src, NULL, NULL},  // cube_vertex
+        {model_vrtx_shdr_src, NULL, NULL}, // model_vertex
+        {NULL, model_geom_shdr_src, NULL}, // model_geometry, only built with face layers
+    };
+    int32_t program_count = scene.face_layers ? 3 : 2;
+    PROF_BEGIN("submit_programs");
+    glh_submit_programs(SHADER_CACHE_DIR, programs, program_count);
+    glh_permutations_init(&scene.model_shaders, SHADER_CACHE_DIR, NULL, NULL, model_frag_shdr_src,
+                          material_feature_names, 5, setup_variant, NULL);
+    DrawData material = {0};
+    set_texture(&material);
+    glh_permutations_request(&scene.model_shaders,
+                             material_features(&material) | (scene.face_layers ? MODEL_FACE_LAYERS : 0));
+    glh_permutations_init(&scene.cube_shaders, SHADER_CACHE_DIR, NULL, NULL, cube_frag_shdr_src,
+                          cube_feature_names, 2, setup_variant, NULL);
+    glh_permutations_request(&scene.cube_shaders, cube_features(options->atlas_layers, scene.face_layers));
+    PROF_END();
 
     // Load mesh data from file
     MeshData mesh = {0}; // Initialize mesh data structure
-    if (!load_mesh_data("data/armadillo.bin", &mesh)) {
+    int32_t mesh_status;
+    PROF_ZONE("load_mesh_data", mesh_status = load_mesh_data("data/armadillo.bin", &mesh));
+    if (!mesh_status) {
         // If mesh data is successfully loaded, print information about it
         printf("Loaded the mesh with %d vertices and %d triangles!\n", mesh.vertex_count, mesh.triangle_count);
         printf("Vertex Layout: %d bytes per vertex\n", mesh.vertex_size);
@@ -679,103 +1990,212 @@ int32_t main(int32_t argc, char** argv) {
     }
 
     // Initialize scene data and resources
-    SceneData scene = {0}; // Initialize scene data structure
+    PROF_BEGIN("init_geometry");
     init_cube(&scene);     // Initialize cube data
     init_model(&scene, &mesh); // Initialize model with mesh data
-    init_texture(&scene, &mesh); // Initialize texture for the model
-
-    // Set the viewport size to match the window dimensions
-    glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+    PROF_END();
+
+    // Wait for the stage programs, the first render in init_texture needs them. The armadillo's
+    // variant is waited for when init_render_states asks for it
+    int32_t failed_programs;
+    PROF_ZONE("finish_programs", failed_programs = glh_finish_programs(programs, program_count));
+    if (failed_programs) {
+        fprintf(stderr, "[ERROR] Failed to build shader programs!\n");
+        exit(EXIT_FAILURE);
+    }
+    scene.cube_vertex = programs[0].program;
+    scene.model_vertex = programs[1].program;
+    scene.model_geometry = scene.face_layers ? programs[2].program : 0;
+    init_frame_data(&scene); // Camera, light and the per-frame uniform buffer
+    if (scene.face_layers) {
+        init_face_data(&scene); // The cameras of the six faces
+    }
+    init_offscreen_targets(&scene); // Offscreen size from the cubes' size on screen
+    scene.atlas_layers = fit_atlas_layers(&scene, options->atlas_layers, options->atlas_budget);
+    init_uniforms(&scene); // Resolve uniform handles once, the cube variant depends on the atlas
+    init_draw_data(&scene);  // Ring buffer for the per-draw uniform blocks
+    glh_gpu_timer_init(&scene.gpu_timer); // GPU timestamps around each pass
+    scene.model_timer = glh_gpu_pass(&scene.gpu_timer, "render_model");
+    scene.cube_timer = glh_gpu_pass(&scene.gpu_timer, "frame");
+    scene.frame_timer = glh_gpu_pass(&scene.gpu_timer, "gpu_frame");
+    if (!options->no_occlusion && !scene.atlas_layers) {
+        glh_visibility_init(&scene.cube_visibility); // Occlusion query around the cube draws
+    }
 
-    // Run the rendering loop until the window is closed
-    while (!glfwWindowShouldClose(window)) {
-        render_model(&scene, &mesh); // Render the model
+    PROF_GL_BEGIN("init_texture");
+    init_texture(&scene, &mesh); // Initialize texture for the model and the pass render states
+    PROF_GL_END();
+    if (scene.atlas_layers) {
+        PROF_GL_BEGIN("init_rotation_atlas");
+        init_rotation_atlas(&scene); // Every angle rendered once, the loop never renders the armadillo
+        PROF_GL_END();
+    }
+    PROF_END(); // startup
+
+    // Frame times of a fixed-length run, CPU ones measured here and GPU ones read from the timer
+    // once they come back. Warmup frames are skipped
+    double* cpu_ms = options->frames ? (double*)malloc(options->frames * sizeof(double)) : NULL;
+    double* gpu_ms = options->frames ? (double*)malloc(options->frames * sizeof(double)) : NULL;
+    int32_t cpu_count = 0, gpu_count = 0;
+    uint32_t gpu_read = 0; // GPU frame samples looked at so far
+
+    // Run the rendering loop until the window is closed or the frames are done. Depth testing and
+    // the viewport are part of the pass render states
+    while (!glfwWindowShouldClose(window) && (!options->frames || scene.frame_index < (uint32_t)options->frames)) {
+        PROF_BEGIN("loop"); // One zone per frame, the ones below nest in it
+        double frame_start = glfwGetTime();
+        glh_state_begin_frame(&scene.state); // Count state changes per frame
+        glh_gpu_timer_begin_frame(&scene.gpu_timer); // Collect the pass times that are ready
+        glh_visibility_begin_frame(&scene.cube_visibility); // And the cubes' visibility, for update_draw_data
+        if (gpu_ms) {
+            collect_gpu_frames(&scene, options->warmup, &gpu_read, gpu_ms, &gpu_count);
+        }
+        PROF_ZONE("update_frame_data", update_frame_data(&scene)); // Upload the frame-global uniforms once for all passes
+        PROF_ZONE("update_draw_data", update_draw_data(&scene));   // Write the per-draw uniforms of every draw at once
+
+        // Draw submission, also marked as debug groups for graphics debuggers
+        glh_gpu_begin(&scene.gpu_timer, scene.frame_timer);
+        if (scene.model_stale) {
+            PROF_GL_BEGIN("render_model");
+            render_model(&scene, &mesh); // Render the model, otherwise the cubes reuse its texture
+            PROF_GL_END();
+        }
+        PROF_GL_BEGIN("frame");
         frame(&scene, &mesh);        // Update the frame (for animation, etc.)
+        PROF_GL_END();
+        glh_gpu_end(&scene.gpu_timer, scene.frame_timer);
+        glh_uniform_ring_end_frame(&scene.draw_ring); // Fence this frame's draw data
         
         // Swap the front and back buffers to display the rendered image
-        glfwSwapBuffers(window);
+        PROF_ZONE("glfwSwapBuffers", glfwSwapBuffers(window));
         
         // Poll for and process events like input and window resize
-        glfwPollEvents();
+        PROF_ZONE("glfwPollEvents", glfwPollEvents());
+        if (cpu_ms && scene.frame_index >= (uint32_t)options->warmup) {
+            cpu_ms[cpu_count++] = (glfwGetTime() - frame_start) * 1000.0;
+        }
+        scene.frame_index++; // Advances the fixed timestep clock
+        PROF_END(); // loop
+    }
+
+    // Wait for the last frames' queries and write the report of a fixed-length run
+    int8_t status = 0;
+    if (options->frames) {
+        glFinish();
+        glh_gpu_timer_begin_frame(&scene.gpu_timer);
+        collect_gpu_frames(&scene, options->warmup, &gpu_read, gpu_ms, &gpu_count);
+        if (suite) {
+            add_scene_results(suite, config, cpu_ms, cpu_count, gpu_ms, gpu_count);
+        } else {
+            status = write_frame_report(options, &scene, cpu_ms, cpu_count, gpu_ms, gpu_count);
+        }
+    }
+    free(cpu_ms);
+    free(gpu_ms);
+
+    // Report how much GL state the tracker saved, the same every frame once the loop is running
+    printf("Render state calls in the last frame: %u made, %u elided\n", scene.state.changes, scene.state.elided);
+    print_gpu_times(&scene);
+    print_cache_stats(&scene);
+    if (!scene.atlas_layers) { // The atlas printed its size at startup
+        printf("Offscreen target: %dx%d%s, switched %u times\n", scene.targets[scene.target].width,
+               scene.targets[scene.target].height, scene.face_layers ? " x 6 faces in one draw" : "",
+               scene.target_switches);
     }
 
     // Clean up resources before exiting
     glDeleteVertexArrays(1, &scene.cube_vao);  // Delete the cube's VAO
     glDeleteVertexArrays(1, &scene.model_vao); // Delete the model's VAO
-    glDeleteProgram(scene.basic_program);      // Delete the basic shader program
-    glDeleteProgram(scene.model_program);      // Delete the model shader program
+    glh_pipelines_free(&scene.pipelines);      // Delete the program pipelines
+    glDeleteProgram(scene.cube_vertex);        // Delete the cube stage programs
+    glh_permutations_free(&scene.cube_shaders);
+    free_offscreen_targets(&scene);            // Delete the offscreen targets that were used
+    glDeleteTextures(1, &scene.atlas_texture); // Delete the rotation atlas, if there is one
+    glDeleteProgram(scene.model_vertex);       // Delete the armadillo vertex stage
+    glDeleteProgram(scene.model_geometry);     // And the face layers' geometry stage, if there is one
+    glh_permutations_free(&scene.model_shaders); // Delete every armadillo fragment variant
+    glDeleteBuffers(1, &scene.frame_ubo);      // Delete the frame uniform buffer
+    glDeleteBuffers(1, &scene.face_ubo);       // Delete the face cameras, if there are any
+    glh_uniform_ring_free(&scene.draw_ring);   // Delete the draw data ring and its fences
+    glh_gpu_timer_free(&scene.gpu_timer);      // Delete the timer queries
+    glh_visibility_free(&scene.cube_visibility); // And the occlusion queries
     free(mesh.vertex_data);   // Free the vertex data memory
     free(mesh.triangles);     // Free the triangle index memory
     glfwDestroyWindow(window); // Destroy the GLFW window
-    glfwTerminate();           // Terminate GLFW
-    return 0; // Return success code
-
+    return status; // Return success code, or 1 when the report could not be written
 }
 
-// Implementation of data loading, out of the way
-int32_t load_mesh_data(const char* filename, MeshData* out_data) {
-    FILE *file = fopen(filename, "rb");
-    
-    if (!file) {
-        perror("Failed to open file");
-        return EXIT_FAILURE;
+// Run every scenario of the suite that passes the filter, then write and compare the results.
+// Returns 1 on failure or when a scenario got slower than the baseline
+int8_t run_suite(const RunOptions* options) {
+    bench_options_t bench_options = bench_default_options();
+    bench_options.filter = options->filter;
+    bench_suite_t suite;
+    bench_init(&suite, bench_options);
+
+    int8_t status = 0;
+    for (int32_t i = 0; i < SUITE_SCENARIOS && !status; ++i) {
+        char cpu_name[BENCH_NAME_LENGTH], gpu_name[BENCH_NAME_LENGTH];
+        snprintf(cpu_name, sizeof(cpu_name), "scene/%s/cpu_frame", suite_configs[i].name);
+        snprintf(gpu_name, sizeof(gpu_name), "scene/%s/gpu_frame", suite_configs[i].name);
+        if (!bench_selected(&suite, cpu_name) && !bench_selected(&suite, gpu_name)) {
+            continue; // Neither of its results is wanted, skip creating the window
+        }
+        status = run_scene(options, &suite_configs[i], &suite);
     }
-
-    if (fread(&out_data->vertex_count, sizeof(uint32_t), 1, file) != 1) {
-        perror("Failed to read vertex count");
-        fclose(file);
-        return EXIT_FAILURE;
+    if (!status && options->json_path) {
+        status = bench_write_json(&suite, options->json_path);
     }
-
-    // Read triangle count (1 byte)
-    if (fread(&out_data->triangle_count, sizeof(uint32_t), 1, file) != 1) {
-        perror("Failed to read triangle count");
-        fclose(file);
-        return EXIT_FAILURE;
+    if (!status && options->csv_path) {
+        status = bench_write_csv(&suite, options->csv_path);
     }
 
-    // Allocate memory for vertex data 
-    out_data->vertex_size = 6 * sizeof(float);
-    size_t vertex_data_size = out_data->vertex_count * out_data->vertex_size;
-    out_data->vertex_data = (float *)malloc(vertex_data_size);
-    if (!out_data->vertex_data) {
-        perror("Failed to allocate memory for vertices");
-        fclose(file);
-        return EXIT_FAILURE;
+    // Flag scenarios more than the threshold slower than the baseline, beyond their noise
+    if (!status && options->baseline_path) {
+        bench_suite_t baseline;
+        bench_init(&baseline, bench_options);
+        if (bench_read_json(&baseline, options->baseline_path)) {
+            fprintf(stderr, "[ERROR] Could not read %s!\n", options->baseline_path);
+            status = 1;
+        } else if (bench_compare(&baseline, &suite, options->threshold / 100.0, stdout)) {
+            status = 1;
+        }
+        bench_free(&baseline);
     }
+    bench_free(&suite);
+    return status;
+}
 
-    // Read vertex data
-    if (fread(out_data->vertex_data, 1, vertex_data_size, file) != vertex_data_size) {
-        perror("Failed to read vertex data");
-        free(out_data->vertex_data);
-        fclose(file);
+int32_t main(int32_t argc, char** argv) {
+    // Parse the command line, e.g. --headless --frames 1000 --json frames.json
+    RunOptions options;
+    if (parse_options(argc, argv, &options)) {
+        printf("usage: %s [--headless] [--frames N] [--warmup N] [--timestep SECONDS] [--json FILE]\n"
+               "          [--cubes N] [--triangles FRACTION] [--texture WxH] [--window WxH]\n"
+               "          [--cache-angle DEGREES] [--cache-texels N] [--cache-rate HZ] [--no-cache]\n"
+               "          [--atlas LAYERS] [--atlas-budget MB] [--atlas-blend] [--latency 0-2]\n"
+               "          [--no-scissor] [--no-occlusion] [--faces]\n"
+               "       %s --suite [--frames N] [--filter STR] [--json FILE] [--csv FILE]\n"
+               "          [--baseline FILE] [--threshold PERCENT]\n", argv[0], argv[0]);
         return EXIT_FAILURE;
     }
 
-    // Allocate memory for triangle data 
-    size_t triangle_data_size = out_data->triangle_count * 3 * sizeof(uint32_t);
-    out_data->triangles = (uint32_t *)malloc(triangle_data_size);
-    if (!out_data->triangles) {
-        perror("Failed to allocate memory for triangles");
-        free(out_data->vertex_data);
-        fclose(file);
-        return EXIT_FAILURE;
-    }
+    // Start the CPU profiler clock, every zone below is relative to it
+    PROF_INIT();
+    PROF_THREAD_NAME("main");
 
-    // Read triangle data
-    if (fread(out_data->triangles, 1, triangle_data_size, file) != triangle_data_size) {
-        perror("Failed to read triangle data");
-        free(out_data->vertex_data);
-        free(out_data->triangles);
-        fclose(file);
-        return EXIT_FAILURE;
+    // Initialize GLFW
+    if (!glfwInit()) {
+        // If GLFW fails to initialize, print an error message and terminate the application
+        printf("Failed to initialize GLFW! Terminating\n");
+        exit(EXIT_FAILURE);
     }
 
-    // Close the file
-    fclose(file);
-    out_data->positions_size = 3 * sizeof(float);
-    out_data->positions_offset = 0;
-    out_data->normals_size = 3 * sizeof(float);
-    out_data->normals_offset = 3 * sizeof(float);
-    return 0;
+    // One scene, or every scenario of the suite each in a window of its own
+    int8_t status = options.suite ? run_suite(&options) : run_scene(&options, &options.config, NULL);
+
+    PROF_WRITE_TRACE(TRACE_FILE); // Only with PROF_ENABLED
+    glfwTerminate();              // Terminate GLFW
+    PROF_SHUTDOWN();              // Free the profiler's thread buffers
+    return status ? EXIT_FAILURE : 0;
 }